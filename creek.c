@@ -21,6 +21,13 @@
  * white cell ('W'), and 0 for unknown.
  */
 
+#if defined(STANDALONE_SOLVER) || defined(CREEK_STATS)
+/* The timers use clock_gettime(), which is POSIX, not C99. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -28,9 +35,20 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <stdint.h>
 
 #include "puzzles.h"
 
+#if defined(STANDALONE_SOLVER) && !defined(CREEK_STATS)
+#define CREEK_STATS
+#endif
+#ifdef CREEK_STATS
+#include <time.h>
+#endif
+#ifdef CREEK_PARALLEL
+#include <pthread.h>
+#endif
+
 enum {
     COL_BACKGROUND,
     COL_CURSOR_GRID,
@@ -69,7 +87,17 @@ struct game_params {
 typedef struct game_clues {
     int w, h;
     signed char *clues;
-    int *tmpdsf;
+    struct creek_bits *bits;
+    /* Scratch for execute_move: changed cells, and marks by cell/row */
+    int *touched;
+    unsigned char *cellmark, *rowmark;
+    /*
+     * creek_solve's result on these clues at each difficulty, or -1
+     * if it hasn't been run yet, and the grid it left (see
+     * cached_solve_creek).
+     */
+    int solved[DIFFCOUNT];
+    signed char *solved_grid[DIFFCOUNT];
     int refcount;
 } game_clues;
 
@@ -83,6 +111,9 @@ struct game_state {
     unsigned char *errors;
     bool completed;
     bool used_solve;           /* used to suppress completion flash */
+    /* Summary of errors, kept up to date alongside errors[] */
+    int nfilled, nbad;         /* filled cells, over-full clue points */
+    bool split;                /* white area is disconnected */
 };
 
 static game_params *default_params(void)
@@ -221,69 +252,438 @@ static const char *validate_params(const game_params *params, bool full)
     return NULL;
 }
 
+/*
+ * Hypotheses are tried by running the solver one level deeper,
+ * directly on the caller's grid. The deeper level records every cell
+ * it changes on its trail, and the caller rolls the trail back
+ * afterwards. Probes only ever happen at depth 0, so the scratch for
+ * each depth down to PROBE_DEPTH is allocated up front and the probe
+ * loop itself never allocates.
+ */
+#define PROBE_DEPTH 1
+
+/* ----------------------------------------------------------------------
+ * Bit-packed board.
+ *
+ * Each row of cells is held as two words, a black plane and a white
+ * plane, with bit x standing for column x. Creek grids are at most 12
+ * wide, so a row of cells or a row of W clue points always fits in a
+ * word.
+ *
+ * The planes carry one virtual row above and below the grid, and a
+ * virtual column on either side, all of which count as white. With
+ * that border the white count at a clue point already includes its
+ * missing neighbours, so the usual "nw == nneigh-c" becomes
+ * "nw == 4-c" for every point alike, and a whole row of points can be
+ * evaluated with the same word operations.
+ *
+ * Per-point counts are kept bit-sliced: three words holding bits 0, 1
+ * and 2 of a small number for every point of the row at once.
+ */
+
+typedef uint64_t creek_row;
+
+struct creek_bits {
+    int w, h;
+    creek_row cells, points;    /* masks of the w cells / W points in a row */
+    creek_row *black, *white;   /* h+2 rows; row y+1 holds grid row y */
+    creek_row *has;             /* H rows: points carrying a clue */
+    creek_row *clue[3];         /* H rows: bit-sliced clue value c */
+    creek_row *room[3];         /* H rows: bit-sliced 4-c */
+    creek_row *reach;           /* h+2 rows: scratch for flood fills */
+};
+
+static struct creek_bits *new_bits_creek(int w, int h)
+{
+    struct creek_bits *ret = snew(struct creek_bits);
+    int i;
+
+    assert(w+2 < 64);
+    ret->w = w;
+    ret->h = h;
+    ret->cells = ((creek_row)1 << w) - 1;
+    ret->points = ((creek_row)1 << (w+1)) - 1;
+    ret->black = snewn(h+2, creek_row);
+    ret->white = snewn(h+2, creek_row);
+    ret->has = snewn(h+1, creek_row);
+    ret->reach = snewn(h+2, creek_row);
+    for (i = 0; i < 3; i++) {
+        ret->clue[i] = snewn(h+1, creek_row);
+        ret->room[i] = snewn(h+1, creek_row);
+    }
+    return ret;
+}
+
+static void free_bits_creek(struct creek_bits *b)
+{
+    int i;
+    for (i = 0; i < 3; i++) {
+        sfree(b->clue[i]);
+        sfree(b->room[i]);
+    }
+    sfree(b->reach);
+    sfree(b->has);
+    sfree(b->white);
+    sfree(b->black);
+    sfree(b);
+}
+
+static void bits_set_clues_creek(struct creek_bits *b, const signed char *clues)
+{
+    int W = b->w+1, H = b->h+1;
+    int x, y, i;
+
+    for (y = 0; y < H; y++) {
+        b->has[y] = 0;
+        for (i = 0; i < 3; i++)
+            b->clue[i][y] = b->room[i][y] = 0;
+        for (x = 0; x < W; x++) {
+            int c = clues[y*W+x];
+            if (c < 0)
+                continue;
+            b->has[y] |= (creek_row)1 << x;
+            for (i = 0; i < 3; i++) {
+                if (c & (1 << i))     b->clue[i][y] |= (creek_row)1 << x;
+                if ((4-c) & (1 << i)) b->room[i][y] |= (creek_row)1 << x;
+            }
+        }
+    }
+}
+
+/* Load grid row y (-1 <= y <= h) into the black and white planes. */
+static void bits_load_row_creek(struct creek_bits *b, const signed char *soln,
+                                int y)
+{
+    int w = b->w, x;
+    creek_row bl = 0, wh = ~b->cells;
+
+    if (y < 0 || y >= b->h) {
+        b->black[y+1] = 0;
+        b->white[y+1] = ~(creek_row)0;
+        return;
+    }
+    for (x = 0; x < w; x++) {
+        if (soln[y*w+x] > 0)      bl |= (creek_row)1 << x;
+        else if (soln[y*w+x] < 0) wh |= (creek_row)1 << x;
+    }
+    b->black[y+1] = bl;
+    b->white[y+1] = wh;
+}
+
+static void bits_load_creek(struct creek_bits *b, const signed char *soln)
+{
+    int y;
+
+    for (y = -1; y <= b->h; y++)
+        bits_load_row_creek(b, soln, y);
+}
+
+/*
+ * One step of a flood fill through the non-black cells of row y:
+ * take in whatever has reached the rows above and below, and spread
+ * it sideways. Returns true if the row's reach grew.
+ */
+static bool bits_spread_row_creek(struct creek_bits *b, int y)
+{
+    creek_row open = ~b->black[y] & b->cells, r, prev;
+
+    r = (b->reach[y] | b->reach[y-1] | b->reach[y+1]) & open;
+    do {
+        prev = r;
+        r |= ((r << 1) | (r >> 1)) & open;
+    } while (r != prev);
+    if (r == b->reach[y])
+        return false;
+    b->reach[y] = r;
+    return true;
+}
+
+/*
+ * Return true if the white cells in the loaded planes are 4-connected
+ * through cells that aren't black, as check_connectedness_creek
+ * judges at DIFF_EASY, by flood-filling a whole row at a time.
+ */
+static bool bits_whites_connected_creek(struct creek_bits *b)
+{
+    int h = b->h, y, y0;
+    creek_row seed;
+    bool grew;
+
+    for (y0 = 1; y0 <= h; y0++)
+        if (b->white[y0] & b->cells)
+            break;
+    if (y0 > h)
+        return true;
+
+    for (y = 0; y <= h+1; y++)
+        b->reach[y] = 0;
+    seed = b->white[y0] & b->cells;
+    b->reach[y0] = seed & (~seed + 1);
+    do {
+        grew = false;
+        for (y = 1; y <= h; y++)
+            grew |= bits_spread_row_creek(b, y);
+        for (y = h; y >= 1; y--)
+            grew |= bits_spread_row_creek(b, y);
+    } while (grew);
+
+    for (y = 1; y <= h; y++)
+        if (b->white[y] & b->cells & ~b->reach[y])
+            return false;
+    return true;
+}
+
+/* Bit-sliced sum of four one-bit words. */
+static void count4_creek(creek_row a, creek_row b, creek_row c, creek_row d,
+                         creek_row *sum)
+{
+    creek_row ab0 = a ^ b, ab1 = a & b;
+    creek_row cd0 = c ^ d, cd1 = c & d;
+    creek_row carry = ab0 & cd0;
+
+    sum[0] = ab0 ^ cd0;
+    sum[1] = ab1 ^ cd1 ^ carry;
+    sum[2] = (ab1 & cd1) | (carry & (ab1 ^ cd1));
+}
+
+/* Bit-sliced comparison of two three-bit numbers. */
+static void compare3_creek(const creek_row *p, creek_row *const *q, int y,
+                           creek_row *eq, creek_row *lt)
+{
+    creek_row e2 = ~(p[2] ^ q[2][y]), e1 = ~(p[1] ^ q[1][y]);
+    creek_row e0 = ~(p[0] ^ q[0][y]);
+
+    *eq = e2 & e1 & e0;
+    *lt = (~p[2] & q[2][y]) | (e2 & ~p[1] & q[1][y]) |
+          (e2 & e1 & ~p[0] & q[0][y]);
+}
+
+/*
+ * Evaluate the clue points in row y (0 <= y <= h) against the current
+ * planes. Returns the points whose remaining squares must all be black
+ * or all white, and the points that are already over-full.
+ */
+static void bits_point_row_creek(const struct creek_bits *b, int y,
+                                 creek_row *fill_black, creek_row *fill_white,
+                                 creek_row *bad)
+{
+    creek_row nb[3], nw[3], beq, blt, weq, wlt;
+    creek_row up = b->black[y], down = b->black[y+1];
+
+    count4_creek(up << 1, up, down << 1, down, nb);
+    up = b->white[y]; down = b->white[y+1];
+    count4_creek((up << 1) | 1, up, (down << 1) | 1, down, nw);
+
+    compare3_creek(nb, b->clue, y, &beq, &blt);
+    compare3_creek(nw, b->room, y, &weq, &wlt);
+
+    *fill_black = b->has[y] & weq & blt;
+    *fill_white = b->has[y] & wlt & beq;
+    *bad = b->has[y] & (~(beq | blt) | ~(weq | wlt));
+}
+
+/*
+ * Optional solver and generator telemetry, compiled in with
+ * CREEK_STATS (which the standalone solver always defines).
+ *
+ * The solver counts, for each technique, how often it was tried and
+ * how often it made progress, and times it. Only top-level solves are
+ * broken down like this: the time of a probing technique includes the
+ * nested solves it runs, which are just counted in 'probes'. Each
+ * solver scratch collects its own figures, and folds them into the
+ * global totals when freed, so creek_get_stats() sees them once the
+ * solve or generation that produced them is finished.
+ */
+#define TECHLIST(A) \
+    A(SATURATE,Clue saturation) \
+    A(SINGLE_WHITE,Single white fill) \
+    A(PROBE_3,Probe around 3s) \
+    A(PROBE_1_2,Probe around 1s and 2s) \
+    A(PAIR_2,2-clue pair enumeration) \
+    A(GREY_AREA,Grey area fill)
+#define TECH_ENUM(upper,title) TECH_ ## upper,
+#define TECH_TITLE(upper,title) #title,
+enum { TECHLIST(TECH_ENUM) NTECH };
+
+struct creek_stats {
+    unsigned long solves;           /* top-level creek_solve calls */
+    unsigned long probes;           /* nested creek_solve calls */
+    unsigned long tries[NTECH], hits[NTECH];
+    double seconds[NTECH];
+
+    unsigned long candidates;       /* puzzles built by the generator */
+    unsigned long too_easy;         /* ... rejected as below difficulty */
+    unsigned long unsolved;         /* ... failing the final cold solve */
+    double grid_seconds;            /* time spent in creek_generate */
+    double removal_seconds;         /* time spent removing clues */
+};
+
+#ifdef CREEK_STATS
+/*
+ * The telemetry API, for whatever links against a CREEK_STATS build:
+ * the technique names (indexed like tries, hits and seconds) and the
+ * running totals.
+ */
+extern const char *const creek_technames[NTECH];
+void creek_get_stats(struct creek_stats *out, bool reset);
+
+const char *const creek_technames[NTECH] = { TECHLIST(TECH_TITLE) };
+
+static struct creek_stats creek_total_stats;
+#ifdef CREEK_PARALLEL
+static pthread_mutex_t creek_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static double stats_clock_creek(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void add_stats_creek(struct creek_stats *to,
+                            const struct creek_stats *from)
+{
+    int i;
+
+    to->solves += from->solves;
+    to->probes += from->probes;
+    for (i = 0; i < NTECH; i++) {
+        to->tries[i] += from->tries[i];
+        to->hits[i] += from->hits[i];
+        to->seconds[i] += from->seconds[i];
+    }
+    to->candidates += from->candidates;
+    to->too_easy += from->too_easy;
+    to->unsolved += from->unsolved;
+    to->grid_seconds += from->grid_seconds;
+    to->removal_seconds += from->removal_seconds;
+}
+
+static void flush_stats_creek(struct creek_stats *st)
+{
+#ifdef CREEK_PARALLEL
+    pthread_mutex_lock(&creek_stats_lock);
+#endif
+    add_stats_creek(&creek_total_stats, st);
+#ifdef CREEK_PARALLEL
+    pthread_mutex_unlock(&creek_stats_lock);
+#endif
+    memset(st, 0, sizeof(*st));
+}
+
+/* Copy out the totals collected so far, and optionally reset them. */
+void creek_get_stats(struct creek_stats *out, bool reset)
+{
+#ifdef CREEK_PARALLEL
+    pthread_mutex_lock(&creek_stats_lock);
+#endif
+    *out = creek_total_stats;
+    if (reset)
+        memset(&creek_total_stats, 0, sizeof(creek_total_stats));
+#ifdef CREEK_PARALLEL
+    pthread_mutex_unlock(&creek_stats_lock);
+#endif
+}
+
+#define STAT_CLOCK() stats_clock_creek()
+#define STAT_TECH(st, tech, t0, hit) do {                       \
+        (st)->tries[tech]++;                                    \
+        if (hit) (st)->hits[tech]++;                            \
+        (st)->seconds[tech] += stats_clock_creek() - (t0);      \
+    } while (0)
+#else
+#define STAT_CLOCK() 0.0
+#define STAT_TECH(st, tech, t0, hit) ((void)(t0))
+#endif
+
 struct solver_scratch_creek {
     int *whitedsf;
-    signed char *tmpsoln;
     const signed char *clues;
+    struct creek_bits *bits;
     int depth;
+
+    /* Telemetry, shared down the probe chain (see CREEK_STATS) */
+    struct creek_stats *stats;
+
+    /* Cells changed at this depth, with their previous contents */
+    int *trail;
+    signed char *trailval;
+    int ntrail;
+
+    /* Scratch for the next probe depth down, or NULL */
+    struct solver_scratch_creek *sub;
+
+    /*
+     * Scratch space for the cut vertex search in
+     * solve_single_whites_creek(). Each is w*h long.
+     */
+    int *cutdisc, *cutlow, *cutend, *cutparent, *cutwhites, *cutstack;
+    unsigned char *cutdir;
 };
 
-static struct solver_scratch_creek *new_scratch_creek(int w, int h) {
+static void alloc_cut_scratch_creek(int w, int h, struct solver_scratch_creek *ret) {
+    ret->cutdisc = snewn(w*h, int);
+    ret->cutlow = snewn(w*h, int);
+    ret->cutend = snewn(w*h, int);
+    ret->cutparent = snewn(w*h, int);
+    ret->cutwhites = snewn(w*h, int);
+    ret->cutstack = snewn(w*h, int);
+    ret->cutdir = snewn(w*h, unsigned char);
+}
+
+static struct solver_scratch_creek *new_scratch_depth_creek(int w, int h, int depth) {
     struct solver_scratch_creek *ret = snew(struct solver_scratch_creek);
     ret->whitedsf = snewn(w*h, int);
-    ret->tmpsoln = snewn(w*h, signed char);
-    ret->depth = 0;
+    ret->clues = NULL;
+    ret->bits = new_bits_creek(w, h);
+    ret->depth = depth;
+    /* The hypothesis cells, plus at most one entry per undecided cell */
+    ret->trail = snewn(w*h+2, int);
+    ret->trailval = snewn(w*h+2, signed char);
+    ret->ntrail = 0;
+    ret->sub = (depth < PROBE_DEPTH) ? new_scratch_depth_creek(w, h, depth+1) : NULL;
+    alloc_cut_scratch_creek(w, h, ret);
     return ret;
 }
 
-static struct solver_scratch_creek *dup_scratch_creek(int w, int h, const struct solver_scratch_creek *scc) {
-    struct solver_scratch_creek *ret = snew(struct solver_scratch_creek);
-    if (scc->whitedsf != NULL) {
-        ret->whitedsf = snewn(w*h, int);
-        memcpy(ret->whitedsf, scc->whitedsf, w*h*sizeof(int));
-    }     
-    
-    if (scc->tmpsoln != NULL) {
-        ret->tmpsoln = snewn(w*h, signed char); 
-        memcpy(ret->tmpsoln, scc->tmpsoln, w*h*sizeof(signed char));
-    }
-    ret->clues = scc->clues;
-    ret->depth = scc->depth;
+static struct solver_scratch_creek *new_scratch_creek(int w, int h) {
+    struct solver_scratch_creek *ret = new_scratch_depth_creek(w, h, 0), *s;
+
+    ret->stats = snew(struct creek_stats);
+    memset(ret->stats, 0, sizeof(struct creek_stats));
+    for (s = ret->sub; s; s = s->sub)
+        s->stats = ret->stats;
     return ret;
 }
 
 static void free_scratch_creek(struct solver_scratch_creek *scc) {
+    if (scc->depth == 0) {
+#ifdef CREEK_STATS
+        flush_stats_creek(scc->stats);
+#endif
+        sfree(scc->stats);
+    }
+    if (scc->sub)
+        free_scratch_creek(scc->sub);
+    free_bits_creek(scc->bits);
     sfree(scc->whitedsf);
-    sfree(scc->tmpsoln);
+    sfree(scc->trail);
+    sfree(scc->trailval);
+    sfree(scc->cutdisc);
+    sfree(scc->cutlow);
+    sfree(scc->cutend);
+    sfree(scc->cutparent);
+    sfree(scc->cutwhites);
+    sfree(scc->cutstack);
+    sfree(scc->cutdir);
     sfree(scc);
 }
 
-static int vertex_degree_creek(int w, int h, signed char *soln, int x, int y,
-                         bool anti, int *sx, int *sy)
-{
-    int ret = 0;
-    int neigh = 0;
-    assert(x >= 0 && x <= w && y >= 0 && y <= h);
-    if (x > 0 && y > 0) {
-        neigh++;
-        if( soln[(y-1)*w+(x-1)] == (anti ? -1 : 1) )  ret++;
-    }
-    if (x > 0 && y < h) {
-        neigh++;
-        if (soln[y*w+(x-1)] == (anti ? -1 : 1) )      ret++;
-    }
-    if (x < w && y > 0) {
-        neigh++;
-        if (soln[(y-1)*w+x] == (anti ? -1 : 1) )      ret++;
-    }
-    if (x < w && y < h) {
-        neigh++;
-        if (soln[y*w+x] == (anti ? -1 : 1) )          ret++;
-    }
-
-    return anti ? ret + (4-neigh) : ret;
-}
-
 static bool check_connectedness_creek(int w, int h, int *dsf,
                      signed char *soln, const signed char *clues, int level) {
     int x, y, i, first_white = -1;
@@ -404,64 +804,498 @@ static bool check_connectedness_creek(int w, int h, int *dsf,
     return true;
 }
 
-static bool check_completed_creek(int w, int h,
-           const signed char *clues,
-           signed char *soln,
-           unsigned char *errors,
-           int *dsf)
+/*
+ * Re-examine the clue points in row y (0 <= y <= h) against the loaded
+ * planes, updating their error markings and the count of bad points.
+ */
+static void mark_point_row_creek(game_state *state, int y)
 {
-    int W = w+1, H = h+1;
-    int x, y;
-    bool err = false;
-    memset(errors, 0, W*H);
-
-    if (!check_connectedness_creek(w, h, dsf, soln, clues, DIFF_EASY)) {
-        err = true;
-        for (y = 0; y < h; y++) {
-            for (x = 0; x < w; x++) {
-                if (soln[y*w+x] < 0) {
-                    errors[y*W+x] |= ERR_SQUARE;
-                }
-            }
+    struct creek_bits *b = state->clues->bits;
+    int W = state->p.w+1, x;
+    creek_row fb, fw, bad;
+
+    bits_point_row_creek(b, y, &fb, &fw, &bad);
+    for (x = 0; x < W; x++) {
+        unsigned char *e = &state->errors[y*W+x];
+        bool now = (bad >> x) & 1, was = (*e & ERR_VERTEX) != 0;
+
+        if (now != was) {
+            *e ^= ERR_VERTEX;
+            state->nbad += (now ? +1 : -1);
         }
     }
+}
 
-    for (y = 0; y < H; y++)
-        for (x = 0; x < W; x++) {
-            int c;
+/* Mark a white cell as cut off from the rest, or not. */
+static void mark_square_creek(game_state *state, int i, bool split)
+{
+    int w = state->p.w, W = w+1;
+    unsigned char *e = &state->errors[(i/w)*W + (i%w)];
 
-            if ((c = clues[y*W+x]) < 0)
-                continue;
+    if (split && state->soln[i] < 0)
+        *e |= ERR_SQUARE;
+    else
+        *e &= ~ERR_SQUARE;
+}
 
-            if (vertex_degree_creek(w, h, soln, x, y,
-                             false, NULL, NULL) > c ||
-                vertex_degree_creek(w, h, soln, x, y,
-                             true, NULL, NULL) > 4-c) {
-                errors[y*W+x] |= ERR_VERTEX;
-                err = true;
-            }
-        }
+static bool grid_complete_creek(const game_state *state)
+{
+    return !state->split && state->nbad == 0 &&
+        state->nfilled == state->p.w * state->p.h;
+}
+
+/*
+ * Check a grid from scratch, filling in its error markings and the
+ * summary fields (nfilled, nbad, split) that update_errors_creek then
+ * keeps up to date. Returns true if the grid is complete and correct.
+ */
+static bool check_completed_creek(game_state *state)
+{
+    int w = state->p.w, h = state->p.h, W = w+1, H = h+1;
+    struct creek_bits *b = state->clues->bits;
+    int y, i;
 
+    memset(state->errors, 0, W*H);
+    state->nbad = 0;
+    bits_load_creek(b, state->soln);
+    for (y = 0; y < H; y++)
+        mark_point_row_creek(state, y);
+
+    state->split = !bits_whites_connected_creek(b);
+    state->nfilled = 0;
+    for (i = 0; i < w*h; i++) {
+        if (state->soln[i] != 0)
+            state->nfilled++;
+        if (state->split)
+            mark_square_creek(state, i, true);
+    }
 
-    if (err)
-        return false;
+    return grid_complete_creek(state);
+}
 
-    for (y = 0; y < h; y++)
-    for (x = 0; x < w; x++)
-        if (soln[y*w+x] == 0) return false;
+/*
+ * Bring the error markings and summary fields of ret up to date after
+ * the cells listed in touched[] have changed from their values in old.
+ * Only the clue points at the corners of those cells are looked at
+ * again, and the connectivity of the white area is only rechecked if
+ * a change could have broken it: painting a cell black, or making a
+ * new white cell with no white neighbour in old. Returns true if the
+ * grid is complete and correct.
+ */
+static bool update_errors_creek(game_state *ret, const game_state *old,
+                                const int *touched, int ntouched)
+{
+    int w = ret->p.w, h = ret->p.h, H = h+1;
+    struct creek_bits *b = ret->clues->bits;
+    unsigned char *rowmark = ret->clues->rowmark;
+    bool recheck = old->split, split;
+    int k, y;
+
+    for (k = 0; k < ntouched; k++) {
+        int i = touched[k], x = i % w, was = old->soln[i], now = ret->soln[i];
+
+        y = i / w;
+        if (was == now)
+            continue;
+        ret->nfilled += (now != 0) - (was != 0);
+        rowmark[y] = rowmark[y+1] = 1;
+        if (now > 0)
+            recheck = true;
+        else if (now < 0 &&
+                 !(x > 0   && old->soln[i-1] < 0) &&
+                 !(x < w-1 && old->soln[i+1] < 0) &&
+                 !(y > 0   && old->soln[i-w] < 0) &&
+                 !(y < h-1 && old->soln[i+w] < 0))
+            recheck = true;
+    }
 
-    return true;
+    for (y = 0; y < H; y++) {
+        if (!rowmark[y])
+            continue;
+        rowmark[y] = 0;
+        bits_load_row_creek(b, ret->soln, y-1);
+        bits_load_row_creek(b, ret->soln, y);
+        mark_point_row_creek(ret, y);
+    }
+
+    if (recheck) {
+        bits_load_creek(b, ret->soln);
+        split = !bits_whites_connected_creek(b);
+    } else
+        split = false;
+
+    if (split != old->split) {
+        for (k = 0; k < w*h; k++)
+            mark_square_creek(ret, k, split);
+    } else if (split) {
+        for (k = 0; k < ntouched; k++)
+            mark_square_creek(ret, touched[k], true);
+    }
+    ret->split = split;
+
+    return grid_complete_creek(ret);
 }
 
 static void initialize_solver_creek(int w, int h, const signed char *clues,
                               signed char *soln, struct solver_scratch_creek *scc,
                       int difficulty) {
+    struct solver_scratch_creek *s;
+
     memset(soln, 0, w*h);
     scc->clues = clues;
     dsf_init(scc->whitedsf, w*h);
+    for (s = scc; s; s = s->sub)
+        bits_set_clues_creek(s->bits, clues);
     return;
 }
+
+/*
+ * As initialize_solver_creek, but start from a partly filled grid
+ * instead of an empty one. Every cell filled in 'start' must follow
+ * from some subset of 'clues', or the solver's verdict means nothing.
+ * soln and start may be the same array.
+ */
+static void warm_start_solver_creek(int w, int h, const signed char *clues,
+                                    signed char *soln, const signed char *start,
+                                    struct solver_scratch_creek *scc) {
+    struct solver_scratch_creek *s;
+
+    if (soln != start)
+        memcpy(soln, start, w*h);
+    scc->clues = clues;
+    for (s = scc; s; s = s->sub)
+        bits_set_clues_creek(s->bits, clues);
+}
                       
+/*
+ * Set a grid cell, recording its old contents on the trail if this
+ * is a probe level that will be rolled back.
+ */
+static void set_cell_creek(signed char *soln, struct solver_scratch_creek *scc,
+                           int i, signed char v)
+{
+    if (scc->depth > 0) {
+        scc->trail[scc->ntrail] = i;
+        scc->trailval[scc->ntrail++] = soln[i];
+    }
+    soln[i] = v;
+}
+
+/*
+ * Apply the clue saturation rule - a clue point whose black count or
+ * white count is already met has all its remaining squares filled
+ * with the other colour - to the whole board, one row of clue points
+ * at a time, until nothing more follows. The filled cells are written
+ * back to soln. Returns 0 if some clue point is over-full, otherwise
+ * 1 if anything was filled in, or 2 if not.
+ */
+static int bits_propagate_creek(signed char *soln, struct solver_scratch_creek *scc)
+{
+    struct creek_bits *b = scc->bits;
+    int w = b->w, h = b->h;
+    int x, y, r;
+    bool progress, any = false;
+
+    bits_load_creek(b, soln);
+    do {
+        progress = false;
+        for (y = 0; y <= h; y++) {
+            creek_row fb, fw, bad;
+
+            bits_point_row_creek(b, y, &fb, &fw, &bad);
+            if (bad)
+                return 0;
+            if (!(fb | fw))
+                continue;
+
+            /* A point at x touches the cells at x-1 and x in the
+             * rows on either side of it. */
+            fb |= fb >> 1;
+            fw |= fw >> 1;
+            for (r = y; r <= y+1; r++) {
+                creek_row unknown, nb, nw;
+                if (r == 0 || r == h+1)
+                    continue;
+                unknown = b->cells & ~(b->black[r] | b->white[r]);
+                nb = fb & unknown;
+                nw = fw & unknown;
+                if (nb & nw)
+                    return 0;
+                if (nb | nw) {
+                    b->black[r] |= nb;
+                    b->white[r] |= nw;
+                    progress = any = true;
+                }
+            }
+        }
+    } while (progress);
+
+    if (!any)
+        return 2;
+
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            if (soln[y*w+x] == 0) {
+                if (b->black[y+1] & ((creek_row)1 << x))
+                    set_cell_creek(soln, scc, y*w+x, 1);
+                else if (b->white[y+1] & ((creek_row)1 << x))
+                    set_cell_creek(soln, scc, y*w+x, -1);
+            }
+
+    return 1;
+}
+
+static int creek_solve(int w, int h, const signed char *clues,
+               signed char *soln, struct solver_scratch_creek *scc,
+               int difficulty);
+
+/*
+ * Try the hypothesis that cell j1 (and j2, unless it is negative)
+ * holds v, by running the solver one level down directly on soln.
+ * Everything the deeper level changes is undone before returning, so
+ * soln comes back exactly as it went in.
+ */
+static int probe_creek(int w, int h, const signed char *clues,
+                       signed char *soln, struct solver_scratch_creek *scc,
+                       int difficulty, int j1, int j2, signed char v)
+{
+    struct solver_scratch_creek *sub = scc->sub;
+    int ret;
+
+    assert(sub);
+    sub->clues = clues;
+    sub->ntrail = 0;
+    set_cell_creek(soln, sub, j1, v);
+    if (j2 >= 0)
+        set_cell_creek(soln, sub, j2, v);
+    ret = creek_solve(w, h, clues, soln, sub, difficulty);
+    while (sub->ntrail > 0) {
+        sub->ntrail--;
+        soln[sub->trail[sub->ntrail]] = sub->trailval[sub->ntrail];
+    }
+
+    return ret;
+}
+
+/*
+ * Step from cell (x,y) in direction dir (0 = left, 1 = up, 2 = right,
+ * 3 = down), and return the cell reached, or -1 if the step leaves
+ * the grid or lands on a black cell. Above DIFF_EASY, the step is
+ * also refused if the clues rule out both cells being white, exactly
+ * as in check_connectedness_creek.
+ */
+static int open_neighbour_creek(int w, int h, const signed char *soln,
+                                const signed char *clues, int level,
+                                int x, int y, int dir)
+{
+    int W = w+1;
+    int nx = x, ny = y, c1, c2;
+    bool end1, end2;
+
+    if (dir == 0)      nx--;
+    else if (dir == 1) ny--;
+    else if (dir == 2) nx++;
+    else               ny++;
+    if (nx < 0 || nx >= w || ny < 0 || ny >= h || soln[ny*w+nx] > 0)
+        return -1;
+
+    if (level > DIFF_EASY) {
+        if (dir == 0 || dir == 2) {
+            /* Points at both ends of the vertical edge crossed */
+            c1 = y*W + (dir == 0 ? x : x+1);
+            c2 = c1 + W;
+            end1 = (y == 0); end2 = (y == h-1);
+        } else {
+            /* Points at both ends of the horizontal edge crossed */
+            c1 = (dir == 1 ? y : y+1)*W + x;
+            c2 = c1 + 1;
+            end1 = (x == 0); end2 = (x == w-1);
+        }
+        if (clues[c1] == 3 || clues[c2] == 3 ||
+            (end1 && clues[c1] == 1) || (end2 && clues[c2] == 1))
+            return -1;
+    }
+
+    return ny*w+nx;
+}
+
+/*
+ * Check whether clue point (x,y) is starved: it still needs white
+ * squares, but too few of its open squares are reachable from the
+ * white area. Cell 'cut' and the cells in the DFS subtrees rooted at
+ * the 'nsep' cells in 'sep' are treated as unreachable.
+ */
+static bool clue_starved_creek(int w, int h, const signed char *clues,
+                            const signed char *soln,
+                            const struct solver_scratch_creek *scc,
+                            int x, int y, int cut, const int *sep, int nsep)
+{
+    int W = w+1;
+    int c, nw, nneigh, reach, i, k;
+    int neighbours[4];
+
+    if ((c = clues[y*W+x]) < 0)
+        return false;
+    nneigh = 0;
+    if (x > 0 && y > 0) neighbours[nneigh++] = (y-1)*w+(x-1);
+    if (x > 0 && y < h) neighbours[nneigh++] = y*w+(x-1);
+    if (x < w && y < h) neighbours[nneigh++] = y*w+x;
+    if (x < w && y > 0) neighbours[nneigh++] = (y-1)*w+x;
+
+    nw = reach = 0;
+    for (i = 0; i < nneigh; i++) {
+        int n = neighbours[i];
+        if (soln[n] < 0) nw++;
+        if (soln[n] > 0 || scc->cutdisc[n] < 0 || n == cut)
+            continue;
+        for (k = 0; k < nsep; k++)
+            if (scc->cutdisc[n] >= scc->cutdisc[sep[k]] &&
+                scc->cutdisc[n] < scc->cutend[sep[k]])
+                break;
+        if (k == nsep)
+            reach++;
+    }
+
+    return nw < nneigh-c && reach < nneigh-c;
+}
+
+/*
+ * Fill single white fields. A white cell with exactly one undecided
+ * neighbour forces that neighbour white if making it black would cut
+ * the white area in two (or, at Hard, would leave some clue without
+ * enough reachable open squares).
+ *
+ * Instead of trying each candidate against a freshly built dsf, this
+ * runs one depth-first search over the open cells from the first
+ * white cell, computing Tarjan low-links. The cells cut off by
+ * removing a cell v are then exactly the subtrees of those DFS
+ * children u of v with low[u] >= disc[v], so every candidate can be
+ * judged from the one search.
+ *
+ * Returns the number of cells filled in, or -1 if the grid is already
+ * inconsistent.
+ */
+static int solve_single_whites_creek(int w, int h, const signed char *clues,
+                                     signed char *soln,
+                                     struct solver_scratch_creek *scc,
+                                     int difficulty)
+{
+    int W = w+1, H = h+1;
+    int *disc = scc->cutdisc, *low = scc->cutlow, *end = scc->cutend;
+    int *parent = scc->cutparent, *whites = scc->cutwhites;
+    int *stack = scc->cutstack;
+    unsigned char *dir = scc->cutdir;
+    int x, y, i, d, t, sp, root, nforced;
+
+    root = -1;
+    for (i = 0; i < w*h; i++) {
+        disc[i] = -1;
+        if (root < 0 && soln[i] < 0) root = i;
+    }
+    if (root < 0)
+        return 0;
+
+    t = sp = 0;
+    disc[root] = low[root] = t++;
+    parent[root] = -1;
+    whites[root] = 1;
+    dir[root] = 0;
+    stack[sp++] = root;
+    while (sp > 0) {
+        int v = stack[sp-1];
+        if (dir[v] < 4) {
+            int u = open_neighbour_creek(w, h, soln, clues, difficulty,
+                                         v%w, v/w, dir[v]++);
+            if (u < 0)
+                continue;
+            if (disc[u] < 0) {
+                disc[u] = low[u] = t++;
+                parent[u] = v;
+                whites[u] = (soln[u] < 0);
+                dir[u] = 0;
+                stack[sp++] = u;
+            } else if (u != parent[v] && disc[u] < low[v]) {
+                low[v] = disc[u];
+            }
+        } else {
+            int p = parent[v];
+            sp--;
+            end[v] = t;
+            if (p >= 0) {
+                if (low[v] < low[p]) low[p] = low[v];
+                whites[p] += whites[v];
+            }
+        }
+    }
+
+    /* The white area must already be connected ... */
+    for (i = 0; i < w*h; i++)
+        if (soln[i] < 0 && disc[i] < 0)
+            return -1;
+    /* ... and at Hard, no clue may already be starved. */
+    if (difficulty == DIFF_HARD)
+        for (y = 0; y < H; y++)
+            for (x = 0; x < W; x++)
+                if (clue_starved_creek(w, h, clues, soln, scc, x, y,
+                                       -1, NULL, 0))
+                    return -1;
+
+    /*
+     * Judge every candidate against the pre-pass state, collecting
+     * the forced cells on the (now idle) DFS stack.
+     */
+    nforced = 0;
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++) {
+            int nneigh = 0, nj = -1, nsep = 0, sep[4];
+            bool forced = false;
+
+            if (soln[y*w+x] != -1) continue;
+            if (x > 0   && soln[y*w+(x-1)] == 0) { nneigh++; nj = y*w+(x-1); }
+            if (x < w-1 && soln[y*w+(x+1)] == 0) { nneigh++; nj = y*w+(x+1); }
+            if (y > 0   && soln[(y-1)*w+x] == 0) { nneigh++; nj = (y-1)*w+x; }
+            if (y < h-1 && soln[(y+1)*w+x] == 0) { nneigh++; nj = (y+1)*w+x; }
+            if (nneigh != 1 || disc[nj] < 0)
+                continue;
+
+            for (d = 0; d < 4; d++) {
+                int u = open_neighbour_creek(w, h, soln, clues, difficulty,
+                                             nj%w, nj/w, d);
+                if (u >= 0 && parent[u] == nj && low[u] >= disc[nj]) {
+                    sep[nsep++] = u;
+                    if (whites[u] > 0) forced = true;
+                }
+            }
+
+            if (!forced && difficulty == DIFF_HARD) {
+                int x0 = nj%w, y0 = nj/w, cx, cy;
+                if (nsep == 0) {
+                    /* Only the clues at nj's own corners can suffer */
+                    for (cy = y0; cy <= y0+1 && !forced; cy++)
+                        for (cx = x0; cx <= x0+1 && !forced; cx++)
+                            if (clue_starved_creek(w, h, clues, soln, scc,
+                                                   cx, cy, nj, sep, 0))
+                                forced = true;
+                } else {
+                    for (cy = 0; cy < H && !forced; cy++)
+                        for (cx = 0; cx < W && !forced; cx++)
+                            if (clue_starved_creek(w, h, clues, soln, scc,
+                                                   cx, cy, nj, sep, nsep))
+                                forced = true;
+                }
+            }
+
+            if (forced)
+                stack[nforced++] = nj;
+        }
+
+    for (i = 0; i < nforced; i++)
+        if (soln[stack[i]] == 0)
+            set_cell_creek(soln, scc, stack[i], -1);
+
+    return nforced;
+}
+
 static int creek_solve(int w, int h, const signed char *clues,
                signed char *soln, struct solver_scratch_creek *scc,
                int difficulty)
@@ -470,7 +1304,14 @@ static int creek_solve(int w, int h, const signed char *clues,
     int x, y, i, j;
     bool done_something;
     int firstwhite;
+    struct creek_stats *st = scc->stats;
+    bool top = (scc->depth == 0);
+    double t0;
     
+    if (top)
+        st->solves++;
+    else
+        st->probes++;
     if (scc->depth >= 2 && difficulty <= DIFF_TRICKY) return 3;
     
     do {
@@ -479,76 +1320,32 @@ static int creek_solve(int w, int h, const signed char *clues,
      /* Any clue point with the number of remaining filled boxes equal
       * to zero or to the number of remaining unfilled
       * boxes can be filled in completely. */
-        for (y = 0; y < H; y++)
-        for (x = 0; x < W; x++) {
-            int c, nu, nw, nb, nneigh;
-            int neighbours[4];
-            if ((c = clues[y*W+x]) < 0)
-                continue;
-
-            /* We have a clue point. Start by listing its
-             * neighbouring squares, in order around the point */
-            nneigh = 0;
-            if (x > 0 && y > 0) neighbours[nneigh++] = (y-1)*w+(x-1);
-            if (x > 0 && y < h) neighbours[nneigh++] = y*w+(x-1);
-            if (x < w && y < h) neighbours[nneigh++] = y*w+x;
-            if (x < w && y > 0) neighbours[nneigh++] = (y-1)*w+x;
-
-            nu = nw = nb = 0;
-            for (i = 0; i < nneigh; i++) {
-                j = neighbours[i];
-                if (soln[j] == 0) nu++;
-                else if (soln[j] == -1)            nw++;
-                else if (soln[j] == +1)            nb++;
-            }
-
-            if (nw == (nneigh-c) && nb < c) {
-                for (i=0;i<nneigh;i++) {
-                    j = neighbours[i];
-                    if (soln[j] == 0)
-                        soln[j] = 1;
-                }
-                done_something = true;
-            }
-            else if (nw < (nneigh-c) && nb == c) {
-                for (i=0;i<nneigh;i++) {
-                    j = neighbours[i];
-                    if (soln[j] == 0)
-                        soln[j] = -1;
-                }
-                done_something = true;
-            }
-            else if (nb > c || nw > (nneigh-c)) {
-                return 0;           /* impossible */
-            }
-
+        t0 = STAT_CLOCK();
+        i = bits_propagate_creek(soln, scc);
+        if (top)
+            STAT_TECH(st, TECH_SATURATE, t0, i != 2);
+        switch (i) {
+          case 0:
+            return 0;               /* impossible */
+          case 1:
+            done_something = true;
+            break;
         }
         if (done_something) continue;
 
         /* Fill single white fields */
-        if (scc->depth == 0 || difficulty == DIFF_HARD) 
-        for (y = 0; y < h; y++)
-        for (x = 0; x < w; x++) {
-            int nneigh, nj;
-            if (soln[y*w+x] != -1) continue;
-            
-            nneigh = 0;
-            if (x > 0   && soln[y*w+(x-1)] == 0) { nneigh++; nj = y*w+(x-1); }
-            if (x < w-1 && soln[y*w+(x+1)] == 0) { nneigh++; nj = y*w+(x+1); }
-            if (y > 0   && soln[(y-1)*w+x] == 0) { nneigh++; nj = (y-1)*w+x; }
-            if (y < h-1 && soln[(y+1)*w+x] == 0) { nneigh++; nj = (y+1)*w+x; }
-            
-            if (nneigh == 1) {
-                memcpy (scc->tmpsoln, soln, w*h*sizeof(signed char));
-                scc->tmpsoln[nj] = 1;
-                if (!check_connectedness_creek(w, h, scc->whitedsf, scc->tmpsoln, clues, difficulty)) {
-                    soln[nj] = -1;
-                    done_something = true;
-                }
-                if (done_something) break;
-            }
-            if (done_something) break;
-        }        
+        if (scc->depth == 0 || difficulty == DIFF_HARD) {
+            int filled;
+
+            t0 = STAT_CLOCK();
+            filled = solve_single_whites_creek(w, h, clues, soln, scc, difficulty);
+            if (top)
+                STAT_TECH(st, TECH_SINGLE_WHITE, t0, filled != 0);
+            if (filled < 0)
+                return 0;           /* impossible */
+            if (filled > 0)
+                done_something = true;
+        }
         if (done_something) continue;
         
         if (difficulty >= DIFF_TRICKY && scc->depth == 0) {
@@ -582,77 +1379,52 @@ static int creek_solve(int w, int h, const signed char *clues,
                 if (c == 2 && nu == 4) no = 6;
                 
                 if (c == 3 && no > 0) {
+                    t0 = STAT_CLOCK();
                     for (i = 0;i < nneigh; i++) {
-                        int ret;
-                        struct solver_scratch_creek *tscc = dup_scratch_creek(w,h,scc);
-                        memcpy(scc->tmpsoln, soln, w*h*sizeof(signed char));
-                        tscc->depth = 1;
                         j = neighbours[i];
-                        if (soln[j] == 0) {
-                            scc->tmpsoln[j] = -1;
-                            ret = creek_solve(w,h,clues,scc->tmpsoln, tscc, difficulty);
-                            if (ret == 0) {
-                                done_something = true;
-                                soln[j] = 1;
-                            }
+                        if (soln[j] == 0 &&
+                            probe_creek(w, h, clues, soln, scc, difficulty, j, -1, -1) == 0) {
+                            done_something = true;
+                            soln[j] = 1;
                         }
-                        free_scratch_creek(tscc);
                         if (done_something) break;
                     }
+                    STAT_TECH(st, TECH_PROBE_3, t0, done_something);
                 }
 
                 if ((c == 1 || c == 2) && no > 0 && difficulty == DIFF_HARD) {
+                    t0 = STAT_CLOCK();
                     for (i = 0; i < nneigh; i++) {
-                        int ret;
-                        struct solver_scratch_creek *tscc = dup_scratch_creek(w,h,scc);
-                        memcpy(scc->tmpsoln, soln, w*h*sizeof(signed char));
-                        tscc->depth = 1;
                         j = neighbours[i];
-                        if (soln[j] == 0) {
-                            scc->tmpsoln[j] = 1;
-                            ret = creek_solve(w,h,clues,scc->tmpsoln, tscc, difficulty);
-                            if (ret == 0) {
-                                done_something = true;
-                                soln[j] = -1;
-                            }
+                        if (soln[j] == 0 &&
+                            probe_creek(w, h, clues, soln, scc, difficulty, j, -1, 1) == 0) {
+                            done_something = true;
+                            soln[j] = -1;
                         }
-                        free_scratch_creek(tscc);
                         if (done_something) break;
 
                         if (c == 2) {
-                            tscc = dup_scratch_creek(w,h,scc);
-                            memcpy(scc->tmpsoln, soln, w*h*sizeof(signed char));                    
-                            tscc->depth = 1;
-                            j = neighbours[i];
-                            if (soln[j] == 0) {
-                                scc->tmpsoln[j] = -1;
-                                ret = creek_solve(w,h,clues,scc->tmpsoln, tscc, difficulty);
-                                if (ret == 0) {
-                                    done_something = true;
-                                    soln[j] = 1;
-                                }
+                            if (soln[j] == 0 &&
+                                probe_creek(w, h, clues, soln, scc, difficulty, j, -1, -1) == 0) {
+                                done_something = true;
+                                soln[j] = 1;
                             }
-                            free_scratch_creek(tscc);
                             if (done_something) break;
                         }
                     }
+                    STAT_TECH(st, TECH_PROBE_1_2, t0, done_something);
 
                     if (c == 2 && no == 6) {
                         int ret;
                         int r1,r2;
                         int cb[4];
-                        struct solver_scratch_creek *tscc;
                         for (i=0;i<4;i++) cb[i] = 0;
+                        t0 = STAT_CLOCK();
                             
                         for (r1=0;r1<3;r1++)
                         for (r2=r1+1;r2<4;r2++) {
-                            tscc = dup_scratch_creek(w,h,scc);
-                            memcpy(scc->tmpsoln, soln, w*h*sizeof(signed char));
-                            tscc->depth = 1;
-                            scc->tmpsoln[neighbours[r1]] = 1;
-                            scc->tmpsoln[neighbours[r2]] = 1;
-                            ret = creek_solve(w,h,clues,scc->tmpsoln, tscc, difficulty);
-                            free_scratch_creek(tscc);
+                            ret = probe_creek(w, h, clues, soln, scc, difficulty,
+                                              neighbours[r1], neighbours[r2], 1);
                             if (ret == 0) {
                                 cb[r1]++;
                                 cb[r2]++;
@@ -666,6 +1438,7 @@ static int creek_solve(int w, int h, const signed char *clues,
                                 soln[j] = -1;
                             }
                         }
+                        STAT_TECH(st, TECH_PAIR_2, t0, done_something);
                     }
                 }
                 if (done_something) break;
@@ -674,6 +1447,7 @@ static int creek_solve(int w, int h, const signed char *clues,
         if (done_something) continue;
 
         /* Fill in isolated grey areas */
+        t0 = STAT_CLOCK();
         firstwhite = -1;
         for (i=0;i<w*h;i++)
             if (soln[i] == -1) {
@@ -695,211 +1469,714 @@ static int creek_solve(int w, int h, const signed char *clues,
             for (i=0;i<w*h;i++) {
                 if (soln[i] == 0) {
                     if (dsf_canonify(scc->whitedsf, i) != dsf_canonify(scc->whitedsf, firstwhite)) {
-                        soln[i] = 1;
+                        set_cell_creek(soln, scc, i, 1);
                         done_something = true; 
                     }
                 }
             }
         }
-        if (done_something) continue;
+        if (top)
+            STAT_TECH(st, TECH_GREY_AREA, t0, done_something);
+        if (done_something) continue;
+
+    } while (done_something);
+
+       /* Check if grid is connected */
+       if (!check_connectedness_creek(w, h, scc->whitedsf, soln, clues, DIFF_EASY)) {
+           return 0;
+       }
+
+    /* Solver can make no more progress. See if the grid is full. */
+    for (i = 0; i < w*h; i++)
+        if (soln[i] == 0) {
+            return 2;               /* failed to converge */
+        }
+
+    return 1;                   /* success */
+}
+
+
+/*
+ * Run the solver on a game's clues from an empty grid at the given
+ * difficulty, or fetch what it found the last time it was asked, so
+ * that repeated Solve presses and grading don't repeat the work.
+ * Returns creek_solve's result, with its grid in soln.
+ */
+static int cached_solve_creek(game_clues *gc, int diff, signed char *soln)
+{
+    int w = gc->w, h = gc->h;
+
+    if (gc->solved[diff] < 0) {
+        struct solver_scratch_creek *scc = new_scratch_creek(w, h);
+
+        gc->solved_grid[diff] = snewn(w*h, signed char);
+        initialize_solver_creek(w, h, gc->clues, gc->solved_grid[diff],
+                                scc, diff);
+        gc->solved[diff] = creek_solve(w, h, gc->clues, gc->solved_grid[diff],
+                                       scc, diff);
+        free_scratch_creek(scc);
+    }
+    memcpy(soln, gc->solved_grid[diff], w*h);
+    return gc->solved[diff];
+}
+
+/*
+ * Filled-grid generator.
+ *
+ * Cells are painted black one at a time, each picked at random from
+ * the remaining whites and rejected if it would split the white area.
+ * Rather than rebuilding a dsf over the whole board for every
+ * candidate, a candidate first gets a purely local test: if its white
+ * neighbours are already joined to each other through the eight cells
+ * around it, it can't be a cut vertex. Only when that is inconclusive
+ * do we fall back to a full articulation point search, whose result
+ * stays valid until the next cell is painted. The random choices and
+ * accept/reject decisions are exactly those of checking connectivity
+ * from scratch each time.
+ */
+
+/*
+ * Return true if the white neighbours of cell i are 4-connected to
+ * each other within the ring of eight cells around it (off-board
+ * cells counting as black).
+ */
+static bool locally_removable_creek(int w, int h, const signed char *soln,
+                                    int i)
+{
+    static const int rdx[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+    static const int rdy[8] = { -1, -1, 0, 1, 1, 1, 0, -1 };
+    bool ring[8], inrun, edge;
+    int x = i % w, y = i / w, k, start, runs;
+
+    for (k = 0; k < 8; k++) {
+        int nx = x + rdx[k], ny = y + rdy[k];
+        ring[k] = (nx >= 0 && nx < w && ny >= 0 && ny < h &&
+                   soln[ny*w+nx] < 0);
+    }
+
+    /*
+     * Walk round the ring from a black cell, counting the runs of
+     * white cells that contain at least one edge neighbour (the even
+     * positions).
+     */
+    for (start = 0; start < 8 && ring[start]; start++);
+    if (start == 8)
+        return true;
+    runs = 0;
+    inrun = edge = false;
+    for (k = 1; k <= 8; k++) {
+        int r = (start + k) % 8;
+        if (ring[r]) {
+            inrun = true;
+            if (r % 2 == 0) edge = true;
+        } else {
+            if (inrun && edge) runs++;
+            inrun = edge = false;
+        }
+    }
+    return runs <= 1;
+}
+
+/*
+ * A wider version of the same test: return true if the white
+ * neighbours of cell i can all reach each other without passing
+ * through i or leaving the square of side 2*LOCAL_RADIUS+1 centred
+ * on it.
+ */
+#define LOCAL_RADIUS 3
+#define LOCAL_SIDE (2*LOCAL_RADIUS+1)
+static bool window_removable_creek(int w, int h, const signed char *soln,
+                                   int i)
+{
+    bool seen[LOCAL_SIDE*LOCAL_SIDE];
+    int queue[LOCAL_SIDE*LOCAL_SIDE];
+    int x0 = i % w - LOCAL_RADIUS, y0 = i / w - LOCAL_RADIUS;
+    int head, tail, d, nn, reached;
+
+    memset(seen, 0, sizeof(seen));
+    seen[LOCAL_RADIUS*LOCAL_SIDE+LOCAL_RADIUS] = true;
+    head = tail = nn = reached = 0;
+    for (d = 0; d < 4; d++) {
+        int lx = LOCAL_RADIUS + (d == 0 ? -1 : d == 2 ? 1 : 0);
+        int ly = LOCAL_RADIUS + (d == 1 ? -1 : d == 3 ? 1 : 0);
+        int x = x0 + lx, y = y0 + ly;
+        if (x < 0 || x >= w || y < 0 || y >= h || soln[y*w+x] >= 0)
+            continue;
+        if (nn++ == 0) {
+            seen[ly*LOCAL_SIDE+lx] = true;
+            queue[tail++] = ly*LOCAL_SIDE+lx;
+        }
+    }
+
+    while (head < tail) {
+        int l = queue[head++], lx = l % LOCAL_SIDE, ly = l / LOCAL_SIDE;
+        if (abs(lx - LOCAL_RADIUS) + abs(ly - LOCAL_RADIUS) == 1)
+            reached++;
+        for (d = 0; d < 4; d++) {
+            int mx = lx + (d == 0 ? -1 : d == 2 ? 1 : 0);
+            int my = ly + (d == 1 ? -1 : d == 3 ? 1 : 0);
+            int x = x0 + mx, y = y0 + my;
+            if (mx < 0 || mx >= LOCAL_SIDE || my < 0 || my >= LOCAL_SIDE ||
+                seen[my*LOCAL_SIDE+mx])
+                continue;
+            if (x < 0 || x >= w || y < 0 || y >= h || soln[y*w+x] >= 0)
+                continue;
+            seen[my*LOCAL_SIDE+mx] = true;
+            queue[tail++] = my*LOCAL_SIDE+mx;
+        }
+    }
+
+    return reached == nn;
+}
+
+/*
+ * Mark in cut[] the articulation points of the 4-connected white area
+ * (which must be connected). The other arrays are w*h scratch.
+ */
+static void find_cut_cells_creek(int w, int h, const signed char *soln,
+                                 bool *cut, int *disc, int *low,
+                                 int *parent, int *stack,
+                                 unsigned char *dir)
+{
+    int i, t, sp, root, rootkids;
+
+    root = -1;
+    for (i = 0; i < w*h; i++) {
+        disc[i] = -1;
+        cut[i] = false;
+        if (root < 0 && soln[i] < 0) root = i;
+    }
+    if (root < 0)
+        return;
+
+    t = sp = rootkids = 0;
+    disc[root] = low[root] = t++;
+    parent[root] = -1;
+    dir[root] = 0;
+    stack[sp++] = root;
+    while (sp > 0) {
+        int v = stack[sp-1];
+        if (dir[v] < 4) {
+            int x = v % w, y = v / w, u = -1;
+            switch (dir[v]++) {
+              case 0: if (x > 0)   u = v-1; break;
+              case 1: if (y > 0)   u = v-w; break;
+              case 2: if (x < w-1) u = v+1; break;
+              case 3: if (y < h-1) u = v+w; break;
+            }
+            if (u < 0 || soln[u] >= 0)
+                continue;
+            if (disc[u] < 0) {
+                disc[u] = low[u] = t++;
+                parent[u] = v;
+                dir[u] = 0;
+                stack[sp++] = u;
+                if (v == root) rootkids++;
+            } else if (u != parent[v] && disc[u] < low[v]) {
+                low[v] = disc[u];
+            }
+        } else {
+            int p = parent[v];
+            sp--;
+            if (p >= 0) {
+                if (low[v] < low[p]) low[p] = low[v];
+                if (p != root && low[v] >= disc[p]) cut[p] = true;
+            }
+        }
+    }
+    cut[root] = (rootkids > 1);
+}
+
+static void creek_generate(int w, int h, signed char *soln, random_state *rs)
+{
+    int i;
+    int *whites, nw;
+    int *disc, *low, *parent, *stack;
+    unsigned char *dir;
+    bool *cut, cutvalid, ok;
+    int ridx, c;
+
+    memset(soln, -1, w*h);
+    whites = snewn(w*h, int);
+    disc = snewn(w*h, int);
+    low = snewn(w*h, int);
+    parent = snewn(w*h, int);
+    stack = snewn(w*h, int);
+    dir = snewn(w*h, unsigned char);
+    cut = snewn(w*h, bool);
+
+    /* whites[] is kept in ascending order, as a fresh scan would give */
+    nw = 0;
+    for (i=0;i<w*h;i++)
+        whites[nw++] = i;
+    memset(cut, 0, w*h * sizeof(bool));
+    cutvalid = false;
+
+    while(true) {
+        if (nw < (w*h)/3) break;
+        for (i=0;i<(w+h)/2;i++) {
+            ridx = random_upto(rs, nw);
+            c = whites[ridx];
+            ok = locally_removable_creek(w, h, soln, c);
+            if (!ok && !cut[c])
+                ok = window_removable_creek(w, h, soln, c);
+            if (!ok && !cut[c]) {
+                if (!cutvalid) {
+                    find_cut_cells_creek(w, h, soln, cut, disc, low,
+                                         parent, stack, dir);
+                    cutvalid = true;
+                }
+                ok = !cut[c];
+            }
+            if (!ok)
+                continue;
+
+            soln[c] = 1;
+            memmove(whites+ridx, whites+ridx+1, (nw-ridx-1) * sizeof(int));
+            nw--;
+
+            /*
+             * Painting a non-cut cell can create new cut cells but
+             * can't rescue an old one, unless the painted cell was
+             * all there was on one side of it. So the cut[] flags
+             * stay true, except next to a painted dead end, and only
+             * the absence of a flag needs a fresh search.
+             */
+            cutvalid = false;
+            {
+                int x = c % w, y = c / w, nn = 0, n = -1;
+                if (x > 0   && soln[c-1] < 0) { nn++; n = c-1; }
+                if (x < w-1 && soln[c+1] < 0) { nn++; n = c+1; }
+                if (y > 0   && soln[c-w] < 0) { nn++; n = c-w; }
+                if (y < h-1 && soln[c+w] < 0) { nn++; n = c+w; }
+                if (nn == 1)
+                    cut[n] = false;
+            }
+            break;
+        }
+        if (i == (w+h)/2) break;
+    }
+
+    sfree(cut);
+    sfree(dir);
+    sfree(stack);
+    sfree(parent);
+    sfree(low);
+    sfree(disc);
+    sfree(whites);
+}
+
+/*
+ * Number of clue removal candidates sharing one warm start in
+ * new_game_desc.
+ */
+#define REMOVAL_BATCH 8
+
+/*
+ * Identify which clue removal pass a clue point belongs in. If it's an
+ * obvious start point, _or_ we're in DIFF_EASY, then it goes in pass
+ * 0; otherwise pass 1.
+ */
+static int clue_pass_creek(const game_params *params, int x, int y, int v)
+{
+    int W = params->w+1, H = params->h+1;
+    bool xb = (x == 0 || x == W-1);
+    bool yb = (y == 0 || y == H-1);
+
+    if (params->diff == DIFF_EASY || v == 4 || v == 0 ||
+        (v == 2 && (xb||yb)) || (v == 1 && xb && yb))
+        return 0;
+    return 1;
+}
+
+/*
+ * Working space for building one candidate puzzle. new_game_desc may
+ * have several of these on the go at once, one per worker thread.
+ */
+struct generator_creek {
+    const game_params *params;
+    signed char *soln, *tmpsoln, *clues, *kept, *known;
+    int *clueindices;
+    struct solver_scratch_creek *scc;
+};
+
+static struct generator_creek *new_generator_creek(const game_params *params)
+{
+    int w = params->w, h = params->h, W = w+1, H = h+1;
+    struct generator_creek *gen = snew(struct generator_creek);
+
+    gen->params = params;
+    gen->soln = snewn(w*h, signed char);
+    gen->tmpsoln = snewn(w*h, signed char);
+    gen->known = snewn(w*h, signed char);
+    gen->clues = snewn(W*H, signed char);
+    gen->kept = snewn(W*H, signed char);
+    gen->clueindices = snewn(W*H, int);
+    gen->scc = new_scratch_creek(w, h);
+    return gen;
+}
+
+static void free_generator_creek(struct generator_creek *gen)
+{
+    free_scratch_creek(gen->scc);
+    sfree(gen->clueindices);
+    sfree(gen->kept);
+    sfree(gen->clues);
+    sfree(gen->known);
+    sfree(gen->tmpsoln);
+    sfree(gen->soln);
+    sfree(gen);
+}
+
+/*
+ * Build one candidate clue set in gen->clues, drawing all its
+ * randomness from rs. Returns true if it is soluble at exactly the
+ * requested difficulty, in which case gen->tmpsoln holds the solution.
+ */
+static bool generate_candidate_creek(struct generator_creek *gen,
+                                     random_state *rs)
+{
+    const game_params *params = gen->params;
+    int w = params->w, h = params->h, W = w+1, H = h+1;
+    signed char *soln = gen->soln, *tmpsoln = gen->tmpsoln;
+    signed char *clues = gen->clues, *kept = gen->kept, *known = gen->known;
+    int *clueindices = gen->clueindices;
+    struct solver_scratch_creek *scc = gen->scc;
+    struct creek_stats *st = scc->stats;
+    int x, y, v, i, j;
+#ifdef CREEK_STATS
+    double t0;
+#endif
+
+    /*
+     * Create the filled grid.
+     */
+    st->candidates++;
+#ifdef CREEK_STATS
+    t0 = stats_clock_creek();
+#endif
+    creek_generate(w, h, soln, rs);
+#ifdef CREEK_STATS
+    st->grid_seconds += stats_clock_creek() - t0;
+    t0 = stats_clock_creek();
+#endif
+
+    /*
+     * Fill in the complete set of clues.
+     */
+    for (y = 0; y < H; y++) {
+        for (x = 0; x < W; x++) {
+            v = 0;
+            if (x > 0 && y > 0 && soln[(y-1)*w+(x-1)] == +1) v++;
+            if (x > 0 && y < h && soln[y*w+(x-1)] == +1) v++;
+            if (x < w && y > 0 && soln[(y-1)*w+x] == +1) v++;
+            if (x < w && y < h && soln[y*w+x] == +1) v++;
+
+            clues[y*W+x] = v;
+        }
+    }
+    /*
+     * With all clue points filled in, all puzzles are easy: we can
+     * simply process the clue points in lexicographic order, and
+     * at each clue point we will always have at most one square
+     * undecided, which we can then fill in uniquely.
+     */
+    initialize_solver_creek(w, h, clues, tmpsoln, scc, DIFF_EASY);
+    assert(creek_solve(w, h, clues, tmpsoln, scc, DIFF_EASY) == 1);
+
+    /*
+     * Remove as many clues as possible while retaining solubility.
+     *
+     * In DIFF_TRICKY and higher mode, we prioritise the removal of obvious
+     * starting points (4s, 0s, border 2s and corner 1s), on
+     * the grounds that having as few of these as possible
+     * seems like a good thing. In particular, we can often get
+     * away without _any_ completely obvious starting points,
+     * which is even better.
+     *
+     * The solver can only get weaker as clues are taken away, so
+     * whatever follows from a clue set also follows from any
+     * larger one. We exploit that by taking the candidates of a
+     * pass in batches: with the whole batch removed, what the
+     * remaining clues imply ('known') holds for every candidate
+     * clue set tried within the batch, so each candidate is
+     * solved starting from there rather than from an empty
+     * grid. 'kept' tracks the clue set minus the untried part of
+     * the batch; when a clue has to go back, 'known' is brought
+     * up to date from it, again warm.
+     */
+    for (i = 0; i < W*H; i++)
+        clueindices[i] = i;
+    shuffle(clueindices, W*H, sizeof(*clueindices), rs);
+    for (j = 0; j < 2; j++) {
+        int start = 0, nbatch, batch[REMOVAL_BATCH], b;
+
+        while (start < W*H) {
+            nbatch = 0;
+            for (; start < W*H && nbatch < REMOVAL_BATCH; start++) {
+                i = clueindices[start];
+                if (clues[i] >= 0 &&
+                    clue_pass_creek(params, i % W, i / W, clues[i]) == j)
+                    batch[nbatch++] = i;
+            }
+            if (nbatch == 0)
+                break;
+
+            memcpy(kept, clues, W*H);
+            for (b = 0; b < nbatch; b++)
+                kept[batch[b]] = -1;
+            initialize_solver_creek(w, h, kept, known, scc, params->diff);
+            creek_solve(w, h, kept, known, scc, params->diff);
+
+            for (b = 0; b < nbatch; b++) {
+                i = batch[b];
+                v = clues[i];
+                clues[i] = -1;
+                warm_start_solver_creek(w, h, clues, tmpsoln, known, scc);
+                if (creek_solve(w, h, clues, tmpsoln, scc, params->diff) != 1) {
+                    clues[i] = v;               /* put it back */
+                    kept[i] = v;
+                    warm_start_solver_creek(w, h, kept, known, known, scc);
+                    creek_solve(w, h, kept, known, scc, params->diff);
+                }
+            }
+        }
+    }
+    /*
+     * The solver's deductions can depend on the order it finds
+     * them in, so make sure the final clue set also solves from
+     * scratch, as it will for the player. If not, give up on this
+     * candidate.
+     */
+#ifdef CREEK_STATS
+    st->removal_seconds += stats_clock_creek() - t0;
+#endif
+    initialize_solver_creek(w, h, clues, tmpsoln, scc, params->diff);
+    if (creek_solve(w, h, clues, tmpsoln, scc, params->diff) != 1) {
+        st->unsolved++;
+        return false;
+    }
 
-    } while (done_something);
+    /*
+     * And finally, verify that the grid is of _at least_ the
+     * requested difficulty, by running the solver one level
+     * down and verifying that it can't manage it.
+     */
+    if (params->diff > 0) {
+        initialize_solver_creek(w, h, clues, known, scc, params->diff - 1);
+        if (creek_solve(w, h, clues, known, scc, params->diff - 1) <= 1) {
+            st->too_easy++;
+            return false;
+        }
+    }
 
-       /* Check if grid is connected */
-       if (!check_connectedness_creek(w, h, scc->whitedsf, soln, clues, DIFF_EASY)) {
-           return 0;
-       }
+    return true;
+}
 
-    /* Solver can make no more progress. See if the grid is full. */
-    for (i = 0; i < w*h; i++)
-        if (soln[i] == 0) {
-            return 2;               /* failed to converge */
+static char *encode_clues_creek(int w, int h, const signed char *clues)
+{
+    int W = w+1, H = h+1;
+    char *desc, *p;
+    int run, i;
+
+    desc = snewn(W*H+1, char);
+    p = desc;
+    run = 0;
+    for (i = 0; i <= W*H; i++) {
+        int n = (i < W*H ? clues[i] : -2);
+
+        if (n == -1)
+            run++;
+        else {
+            if (run) {
+                while (run > 0) {
+                    int c = 'a' - 1 + run;
+                    if (run > 26)
+                        c = 'z';
+                    *p++ = c;
+                    run -= c - ('a' - 1);
+                }
+            }
+            if (n >= 0)
+                *p++ = '0' + n;
+            run = 0;
         }
+    }
+    assert(p - desc <= W*H);
+    *p++ = '\0';
+    desc = sresize(desc, p - desc, char);
 
-    return 1;                   /* success */
+    return desc;
 }
 
+/* A solved grid as an aux string: one 'B' or 'W' per cell. */
+static char *encode_solution_creek(int w, int h, const signed char *soln)
+{
+    char *aux = snewn(w*h+1, char);
+    int i;
+
+    for (i = 0; i < w*h; i++)
+        aux[i] = (soln[i] > 0 ? 'B' : 'W');
+    aux[w*h] = '\0';
+    return aux;
+}
 
 /*
- * Filled-grid generator.
+ * Candidates are numbered, and candidate k draws its randomness from
+ * a random_state seeded with a base string and k. The base is
+ * SEED_WORDS_CREEK 32-bit words drawn from the caller's random state
+ * before any candidate is built. The accepted puzzle is always the
+ * lowest numbered candidate that qualifies, so it doesn't matter how
+ * many of them are built at once: the same seed gives the same puzzle
+ * for any thread count.
  */
-static void creek_generate(int w, int h, signed char *soln, random_state *rs)
+#define SEED_WORDS_CREEK 5
+
+static random_state *candidate_random_creek(const char *base, int k)
 {
-    int i;
-    int *connected, *whites, nw;
-    int ridx;
+    char seed[8*SEED_WORDS_CREEK + 20];
 
-    memset(soln, -1, w*h);
-    connected = snew_dsf(w*h);
-    whites = snewn(w*h, int);
+    sprintf(seed, "%s,%d", base, k);
+    return random_new(seed, strlen(seed));
+}
 
-    while(true) {
-        nw = 0;
-        for (i=0;i<w*h;i++)
-            if (soln[i] == -1)
-                whites[nw++] = i;
+/*
+ * Number of threads new_game_desc builds candidates on. Zero means
+ * take it from the CREEK_THREADS environment variable, defaulting to
+ * one. Only compiled in with CREEK_PARALLEL; otherwise candidates are
+ * always built one at a time (in the same order, with the same
+ * result).
+ */
+#ifdef CREEK_PARALLEL
+static int creek_generator_threads = 0;
+
+struct parallel_creek {
+    const game_params *params;
+    const char *base;
+    pthread_mutex_t lock;
+    int next;                   /* lowest candidate not yet claimed */
+    int best;                   /* lowest qualifying candidate so far */
+    char *desc;                 /* ... and its encoding */
+    char *aux;                  /* ... and its solution */
+};
 
-        if (nw < (w*h)/3) break;
-        for (i=0;i<(w+h)/2;i++) {
-            ridx = random_upto(rs, nw);
-            soln[whites[ridx]] = 1;
-            if (!check_connectedness_creek(w, h, connected, soln, NULL, DIFF_EASY))
-                soln[whites[ridx]] = -1;
-            else
-                break;
+static void *generator_thread_creek(void *vctx)
+{
+    struct parallel_creek *ctx = (struct parallel_creek *)vctx;
+    struct generator_creek *gen = new_generator_creek(ctx->params);
+
+    while (true) {
+        random_state *rs;
+        bool ok;
+        int k;
+
+        pthread_mutex_lock(&ctx->lock);
+        k = ctx->next;
+        if (ctx->best >= 0 && k > ctx->best) {
+            pthread_mutex_unlock(&ctx->lock);
+            break;
+        }
+        ctx->next++;
+        pthread_mutex_unlock(&ctx->lock);
+
+        rs = candidate_random_creek(ctx->base, k);
+        ok = generate_candidate_creek(gen, rs);
+        random_free(rs);
+
+        if (ok) {
+            char *desc = encode_clues_creek(ctx->params->w, ctx->params->h,
+                                            gen->clues);
+            char *aux = encode_solution_creek(ctx->params->w, ctx->params->h,
+                                              gen->tmpsoln);
+            pthread_mutex_lock(&ctx->lock);
+            if (ctx->best < 0 || k < ctx->best) {
+                ctx->best = k;
+                sfree(ctx->desc);
+                sfree(ctx->aux);
+                ctx->desc = desc;
+                ctx->aux = aux;
+                desc = aux = NULL;
+            }
+            pthread_mutex_unlock(&ctx->lock);
+            sfree(desc);
+            sfree(aux);
         }
-        if (i == (w+h)/2) break;
     }
 
-    sfree(whites);
-    sfree(connected);
+    free_generator_creek(gen);
+    return NULL;
 }
+#endif
 
 static char *new_game_desc(const game_params *params, random_state *rs,
                            char **aux, bool interactive)
 {
-    int w = params->w, h = params->h, W = w+1, H = h+1;
-    signed char *soln, *tmpsoln, *clues;
-    int *clueindices;
-    struct solver_scratch_creek *scc;
-    int x, y, v, i, j;
+    struct generator_creek *gen;
+    char base[8*SEED_WORDS_CREEK + 1];
     char *desc;
-    char cont;
-
-    soln = snewn(w*h, signed char);
-    tmpsoln = snewn(w*h, signed char);
-    clues = snewn(W*H, signed char);
-    clueindices = snewn(W*H, int);
-    scc = new_scratch_creek(w, h);
+    int i, k;
+#ifdef CREEK_PARALLEL
+    int nthreads = creek_generator_threads;
+#endif
 
-    do {
-        /*
-         * Create the filled grid.
-         */
-        creek_generate(w, h, soln, rs);
+    for (i = 0; i < SEED_WORDS_CREEK; i++)
+        sprintf(base + 8*i, "%08lx", random_bits(rs, 32));
 
-        /*
-         * Fill in the complete set of clues.
-         */
-        for (y = 0; y < H; y++) {
-            for (x = 0; x < W; x++) {
-                v = 0;
-                if (x > 0 && y > 0 && soln[(y-1)*w+(x-1)] == +1) v++;
-                if (x > 0 && y < h && soln[y*w+(x-1)] == +1) v++;
-                if (x < w && y > 0 && soln[(y-1)*w+x] == +1) v++;
-                if (x < w && y < h && soln[y*w+x] == +1) v++;
+#ifdef CREEK_PARALLEL
+    if (nthreads <= 0) {
+        const char *env = getenv("CREEK_THREADS");
+        nthreads = (env ? atoi(env) : 1);
+    }
 
-                clues[y*W+x] = v;
-            }
+    if (nthreads > 1) {
+        struct parallel_creek ctx;
+        pthread_t *threads = snewn(nthreads, pthread_t);
+        int t, started = 0;
+
+        ctx.params = params;
+        ctx.base = base;
+        pthread_mutex_init(&ctx.lock, NULL);
+        ctx.next = 0;
+        ctx.best = -1;
+        ctx.desc = ctx.aux = NULL;
+        for (t = 0; t < nthreads; t++)
+            if (pthread_create(&threads[started], NULL,
+                               generator_thread_creek, &ctx) == 0)
+                started++;
+        for (t = 0; t < started; t++)
+            pthread_join(threads[t], NULL);
+        pthread_mutex_destroy(&ctx.lock);
+        sfree(threads);
+
+        if (ctx.desc) {
+            if (aux)
+                *aux = ctx.aux;
+            else
+                sfree(ctx.aux);
+            return ctx.desc;
         }
-        /*
-         * With all clue points filled in, all puzzles are easy: we can
-         * simply process the clue points in lexicographic order, and
-         * at each clue point we will always have at most one square
-         * undecided, which we can then fill in uniquely.
-         */
-        initialize_solver_creek(w, h, clues, tmpsoln, scc, DIFF_EASY);
-        assert(creek_solve(w, h, clues, tmpsoln, scc, DIFF_EASY) == 1);
+        /* No threads could be started: fall back to doing it here */
+    }
+#endif
 
-        /*
-         * Remove as many clues as possible while retaining solubility.
-         *
-         * In DIFF_TRICKY and higher mode, we prioritise the removal of obvious
-         * starting points (4s, 0s, border 2s and corner 1s), on
-         * the grounds that having as few of these as possible
-         * seems like a good thing. In particular, we can often get
-         * away without _any_ completely obvious starting points,
-         * which is even better.
-         */
-        for (i = 0; i < W*H; i++)
-            clueindices[i] = i;
-        shuffle(clueindices, W*H, sizeof(*clueindices), rs);
-        for (j = 0; j < 2; j++) {
-            for (i = 0; i < W*H; i++) {
-                int pass;
-                bool yb, xb;
-
-                y = clueindices[i] / W;
-                x = clueindices[i] % W;
-                v = clues[y*W+x];
-                if (v == -1) continue;
-
-                /*
-                 * Identify which pass we should process this point
-                 * in. If it's an obvious start point, _or_ we're
-                 * in DIFF_EASY, then it goes in pass 0; otherwise
-                 * pass 1.
-                 */
-                xb = (x == 0 || x == W-1);
-                yb = (y == 0 || y == H-1);
-                if (params->diff == DIFF_EASY || v == 4 || v == 0 ||
-                    (v == 2 && (xb||yb)) || (v == 1 && xb && yb))
-                    pass = 0;
-                else
-                    pass = 1;
-
-                if (pass == j) {
-                    clues[y*W+x] = -1;
-                    initialize_solver_creek(w, h, clues, tmpsoln, scc, params->diff);
-                    if (creek_solve(w, h, clues, tmpsoln, scc, params->diff) != 1)
-                        clues[y*W+x] = v;           /* put it back */
-                }
-            }
-        }
-        /*
-         * And finally, verify that the grid is of _at least_ the
-         * requested difficulty, by running the solver one level
-         * down and verifying that it can't manage it.
-         */
-        if (params->diff > 0) {
-            initialize_solver_creek(w, h, clues, tmpsoln, scc, params->diff - 1);
-            cont = creek_solve(w, h, clues, tmpsoln, scc, params->diff - 1) <= 1;
-        }
-        else
-            cont = false;
+    gen = new_generator_creek(params);
+    for (k = 0;; k++) {
+        random_state *crs = candidate_random_creek(base, k);
+        bool ok = generate_candidate_creek(gen, crs);
+        random_free(crs);
+        if (ok)
+            break;
+    }
 
-    } while (cont);
     /*
      * Now we have the clue set as it will be presented to the
-     * user. Encode it in a game desc.
+     * user. Encode it in a game desc, and pass its solution on to
+     * the Solve button in aux.
      */
-    {
-        char *p;
-        int run, i;
-
-        desc = snewn(W*H+1, char);
-        p = desc;
-        run = 0;
-        for (i = 0; i <= W*H; i++) {
-            int n = (i < W*H ? clues[i] : -2);
-
-            if (n == -1)
-                run++;
-            else {
-                if (run) {
-                    while (run > 0) {
-                        int c = 'a' - 1 + run;
-                        if (run > 26)
-                            c = 'z';
-                        *p++ = c;
-                        run -= c - ('a' - 1);
-                    }
-                }
-                if (n >= 0)
-                    *p++ = '0' + n;
-                run = 0;
-            }
-        }
-        assert(p - desc <= W*H);
-        *p++ = '\0';
-        desc = sresize(desc, p - desc, char);
-    }
-
-    free_scratch_creek(scc);
-    sfree(clueindices);
-    sfree(clues);
-    sfree(tmpsoln);
-    sfree(soln);
+    desc = encode_clues_creek(params->w, params->h, gen->clues);
+    if (aux)
+        *aux = encode_solution_creek(params->w, params->h, gen->tmpsoln);
+    free_generator_creek(gen);
 
     return desc;
 }
@@ -935,7 +2212,7 @@ static game_state *new_game(midend *me, const game_params *params,
     int w = params->w, h = params->h, W = w+1, H = h+1;
     game_state *state = snew(game_state);
     int area = W*H;
-    int squares = 0;
+    int squares = 0, i;
 
     state->p = *params;
     state->soln = snewn(w*h, signed char);
@@ -949,7 +2226,16 @@ static game_state *new_game(midend *me, const game_params *params,
     state->clues->h = h;
     state->clues->clues = snewn(W*H, signed char);
     state->clues->refcount = 1;
-    state->clues->tmpdsf = snewn(W*H*2+W+H, int);
+    for (i = 0; i < DIFFCOUNT; i++) {
+        state->clues->solved[i] = -1;
+        state->clues->solved_grid[i] = NULL;
+    }
+    state->clues->bits = new_bits_creek(w, h);
+    state->clues->touched = snewn(w*h, int);
+    state->clues->cellmark = snewn(w*h, unsigned char);
+    memset(state->clues->cellmark, 0, w*h);
+    state->clues->rowmark = snewn(H, unsigned char);
+    memset(state->clues->rowmark, 0, H);
     memset(state->clues->clues, -1, W*H);
     while (*desc) {
         int n = *desc++;
@@ -961,6 +2247,8 @@ static game_state *new_game(midend *me, const game_params *params,
             assert(!"can't get here");
     }
     assert(squares == area);
+    bits_set_clues_creek(state->clues->bits, state->clues->clues);
+    check_completed_creek(state);
 
     return state;
 }
@@ -975,6 +2263,9 @@ static game_state *dup_game(const game_state *state)
     ret->clues->refcount++;
     ret->completed = state->completed;
     ret->used_solve = state->used_solve;
+    ret->nfilled = state->nfilled;
+    ret->nbad = state->nbad;
+    ret->split = state->split;
 
     ret->soln = snewn(w*h, signed char);
     memcpy(ret->soln, state->soln, w*h);
@@ -987,32 +2278,95 @@ static game_state *dup_game(const game_state *state)
 
 static void free_game(game_state *state)
 {
+    int i;
+
     sfree(state->errors);
     sfree(state->soln);
     assert(state->clues);
     if (--state->clues->refcount <= 0) {
         sfree(state->clues->clues);
-        sfree(state->clues->tmpdsf);
+        free_bits_creek(state->clues->bits);
+        sfree(state->clues->touched);
+        sfree(state->clues->cellmark);
+        sfree(state->clues->rowmark);
+        for (i = 0; i < DIFFCOUNT; i++)
+            sfree(state->clues->solved_grid[i]);
         sfree(state->clues);
     }
     sfree(state);
 }
 
+/*
+ * Build a move string from a per-cell array of actions ('B', 'W', 'C',
+ * or 0 for none), after the given prefix. A single cell is written
+ * "Bx,y"; a run of n cells with the same action, consecutive in
+ * reading order from (x,y), is written "Bx,y,n". Returns NULL if there
+ * is nothing at all to write.
+ */
+static char *encode_cells_creek(int w, int h, const char *act,
+                                const char *prefix)
+{
+    int i, j, len, movelen, movesize;
+    char *move, buf[80];
+
+    movelen = strlen(prefix);
+    movesize = movelen + 256;
+    move = snewn(movesize, char);
+    strcpy(move, prefix);
+    for (i = 0; i < w*h; i = j) {
+        if (!act[i]) {
+            j = i+1;
+            continue;
+        }
+        for (j = i+1; j < w*h && act[j] == act[i]; j++);
+        len = sprintf(buf, "%s%c%d,%d", movelen ? ";" : "",
+                      act[i], i%w, i/w);
+        if (j - i > 1)
+            len += sprintf(buf + len, ",%d", j - i);
+        if (movelen + len >= movesize) {
+            movesize = movelen + len + 256;
+            move = sresize(move, movesize, char);
+        }
+        strcpy(move + movelen, buf);
+        movelen += len;
+    }
+
+    if (movelen == 0) {
+        sfree(move);
+        return NULL;
+    }
+    return move;
+}
+
 static char *solve_game(const game_state *state, const game_state *currstate,
                         const char *aux, const char **error)
 {
     int w = state->p.w, h = state->p.h;
     signed char *soln;
-    int ret;
-    char *move, buf[80];
-    int movelen, movesize;
-    int x, y;
+    int ret, i;
+    char *move, *act;
 
-    struct solver_scratch_creek *scc = new_scratch_creek(w, h);
     soln = snewn(w*h, signed char);
-    initialize_solver_creek(w, h, state->clues->clues, soln, scc, DIFF_HARD);
-    ret = creek_solve(w, h, state->clues->clues, soln, scc, DIFF_HARD);
-    free_scratch_creek(scc);
+
+    /*
+     * A freshly generated puzzle brings its solution along in aux.
+     * Otherwise, a complete solution found at any difficulty is the
+     * only one, so use one if grading has found it already; failing
+     * that, solve at Hard.
+     */
+    ret = -1;
+    if (aux && (int)strlen(aux) == w*h) {
+        for (i = 0; i < w*h; i++)
+            soln[i] = (aux[i] == 'B' ? +1 : -1);
+        ret = 1;
+    }
+    for (i = 0; i < DIFFCOUNT && ret != 1; i++)
+        if (state->clues->solved[i] == 1) {
+            memcpy(soln, state->clues->solved_grid[i], w*h);
+            ret = 1;
+        }
+    if (ret != 1)
+        ret = cached_solve_creek(state->clues, DIFF_HARD, soln);
     if (ret != 1) {
         sfree(soln);
         if (ret == 0)
@@ -1026,24 +2380,13 @@ static char *solve_game(const game_state *state, const game_state *currstate,
      * Construct a move string which turns the current state into
      * the solved state.
      */
-    movesize = 256;
-    move = snewn(movesize, char);
-    movelen = 0;
-    move[movelen++] = 'S';
-    move[movelen] = '\0';
-    for (y = 0; y < h; y++)
-        for (x = 0; x < w; x++) {
-            int v = soln[y*w+x];
-            if (state->soln[y*w+x] != v && soln[y*w+x] != 0) {
-                int len = sprintf(buf, ";%c%d,%d", (v < 0 ? 'W' : 'B'), x, y);
-                if (movelen + len >= movesize) {
-                    movesize = movelen + len + 256;
-                    move = sresize(move, movesize, char);
-                }
-                strcpy(move + movelen, buf);
-                movelen += len;
-            }
-        }
+    act = snewn(w*h, char);
+    for (i = 0; i < w*h; i++) {
+        int v = soln[i];
+        act[i] = (state->soln[i] != v && v != 0 ? (v < 0 ? 'W' : 'B') : 0);
+    }
+    move = encode_cells_creek(w, h, act, "S");
+    sfree(act);
 
     sfree(soln);
 
@@ -1279,91 +2622,104 @@ static char *interpret_move(const game_state *state, game_ui *ui,
             return NULL;
         }
     } else if (button == LEFT_RELEASE || button == RIGHT_RELEASE) {
-        int i, tmplen, buflen, bufsize;
-        char *buf;
-        const char *sep;
-        char tmpbuf[80];
-        buflen = 0;
-        bufsize = 256;
-        buf = snewn(bufsize, char);
-        sep = "";
-        ui->cur_visible = false;
-
-        for (i=0;i<w*h;i++) {
-            if (ui->seln[i]) {
-                tmplen = sprintf(tmpbuf, 
-                    "%s%c%d,%d", sep,
-                         (ui->mode == CLEAR ? 'C' :
-                          ui->mode == BLACK ? 'B' : 'W'),
-                          i%w, i/w);
-                    sep = ";";
-
-                    if (buflen + tmplen >= bufsize) {
-                        bufsize = buflen + tmplen + 256;
-                        buf = sresize(buf, bufsize, char);
-                    }
+        int i;
+        char *act, *buf;
+        char action = (ui->mode == CLEAR ? 'C' :
+                       ui->mode == BLACK ? 'B' : 'W');
 
-                    strcpy(buf+buflen, tmpbuf);
-                    buflen += tmplen;
-            }
+        ui->cur_visible = false;
+        act = snewn(w*h, char);
+        for (i=0;i<w*h;i++)
+            act[i] = (ui->seln[i] ? action : 0);
+        buf = encode_cells_creek(w, h, act, "");
+        sfree(act);
 
-        }
         ui->is_drag = false;
         ui->dx = ui->dy = -1;
         memset(ui->seln, false, w*h);
 
-        if (buflen == 0) {
-            sfree(buf);
+        if (!buf)
             return UI_UPDATE;          /* drag was terminated */
-        } else {
-            buf[buflen] = '\0';
-            return buf;
-        }
+        return buf;
     }
 
     return NULL;
 }
 
+/*
+ * Read a non-negative decimal number, returning a pointer past it, or
+ * NULL if there isn't one.
+ */
+static const char *parse_num_creek(const char *p, int *n)
+{
+    if (!isdigit((unsigned char)*p))
+        return NULL;
+    *n = 0;
+    while (isdigit((unsigned char)*p)) {
+        if (*n > 100000)
+            return NULL;
+        *n = *n * 10 + (*p++ - '0');
+    }
+    return p;
+}
+
 static game_state *execute_move(const game_state *state, const char *move)
 {
     int w = state->p.w, h = state->p.h;
+    game_clues *gc = state->clues;
     char c;
-    int x, y, n;
+    int x, y, n, i, ntouched = 0;
     game_state *ret = dup_game(state);
+
     while (*move) {
         c = *move;
         if (c == 'S') {
             ret->used_solve = true;
             move++;
         } else if (c == 'B' || c == 'W' || c == 'C') {
-            move++;
-            if (sscanf(move, "%d,%d%n", &x, &y, &n) != 2 ||
-                x < 0 || y < 0 || x >= w || y >= h) {
-                free_game(ret);
-                return NULL;
+            n = 1;
+            move = parse_num_creek(move+1, &x);
+            if (move && *move == ',')
+                move = parse_num_creek(move+1, &y);
+            else
+                move = NULL;
+            if (move && *move == ',')
+                move = parse_num_creek(move+1, &n);
+            if (!move || x >= w || y >= h || n < 1 || n > w*h - (y*w+x))
+                goto badmove;
+            for (i = y*w+x; n-- > 0; i++) {
+                ret->soln[i] = (c == 'B' ? 1 : c == 'W' ? -1 : 0);
+                if (!gc->cellmark[i]) {
+                    gc->cellmark[i] = 1;
+                    gc->touched[ntouched++] = i;
+                }
             }
-            ret->soln[y*w+x] = (c == 'B' ? 1 : c == 'W' ? -1 : 0);
-            move += n;
-        } else {
-            free_game(ret);
-            return NULL;
-        }
+        } else
+            goto badmove;
         if (*move == ';')
             move++;
-        else if (*move) {
-            free_game(ret);
-            return NULL;
-        }
+        else if (*move)
+            goto badmove;
     }
 
+    for (i = 0; i < ntouched; i++)
+        gc->cellmark[gc->touched[i]] = 0;
+
     /*
      * We never clear the `completed' flag, but we must always
-     * re-run the completion check because it also highlights
-     * errors in the grid.
+     * update the errors in the grid, which the completion check
+     * also highlights.
      */
-    ret->completed = check_completed_creek(w, h, ret->clues->clues, ret->soln, ret->errors, ret->clues->tmpdsf) || ret->completed;
+    ret->completed = update_errors_creek(ret, state, gc->touched, ntouched) ||
+        ret->completed;
 
     return ret;
+
+  badmove:
+    for (i = 0; i < ntouched; i++)
+        gc->cellmark[gc->touched[i]] = 0;
+    free_game(ret);
+    return NULL;
 }
 
 /* ----------------------------------------------------------------------
@@ -1680,3 +3036,309 @@ const struct game thegame = {
     REQUIRE_RBUTTON,                                 /* flags */
 };
 
+
+#ifdef STANDALONE_SOLVER
+
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define HAVE_RUSAGE
+#endif
+
+const char *quis = NULL;
+
+/*
+ * Grade a clue set: the lowest difficulty that solves it, or -1 if it
+ * is inconsistent, or DIFFCOUNT if even Hard can't finish it. The
+ * solution found at the returned level is left in soln.
+ */
+static int grade_creek(game_clues *gc, signed char *soln)
+{
+    int diff, ret = DIFFCOUNT;
+
+    for (diff = 0; diff < DIFFCOUNT; diff++) {
+        ret = cached_solve_creek(gc, diff, soln);
+        if (ret != 2)
+            break;
+    }
+
+    if (ret == 0)
+        return -1;
+    if (ret != 1)
+        return DIFFCOUNT;
+    return diff;
+}
+
+static void pdiff(int diff)
+{
+    if (diff < 0)
+        printf("Game is impossible.\n");
+    else if (diff >= DIFFCOUNT)
+        printf("Game has no unique solution within the solver's reach.\n");
+    else
+        printf("Game has difficulty %s.\n", creek_diffnames[diff]);
+}
+
+static int solve(game_params *p, const char *desc, bool verbose)
+{
+    game_state *state = new_game(NULL, p, desc);
+    int diff = grade_creek(state->clues, state->soln);
+
+    pdiff(diff);
+    if (verbose) {
+        char *fmt = game_text_format(state);
+        fputs(fmt, stdout);
+        sfree(fmt);
+    }
+    free_game(state);
+    return diff;
+}
+
+static void check(game_params *p)
+{
+    const char *msg = validate_params(p, true);
+    if (msg) {
+        fprintf(stderr, "%s: %s\n", quis, msg);
+        exit(1);
+    }
+}
+
+static void gen(game_params *p, random_state *rs, bool verbose)
+{
+    char *desc, *params;
+
+    check(p);
+    desc = new_game_desc(p, rs, NULL, false);
+    params = encode_params(p, true);
+    printf("%s:%s\n", params, desc);
+    solve(p, desc, verbose);
+    sfree(params);
+    sfree(desc);
+}
+
+static void soak(game_params *p, random_state *rs)
+{
+    time_t tt_start, tt_now, tt_last;
+    char *desc;
+    signed char *soln = snewn(p->w*p->h, signed char);
+    game_state *st;
+    int n = 0, nbad = 0;
+
+    check(p);
+
+    tt_start = tt_now = time(NULL);
+
+    printf("Soak-generating a %dx%d grid, difficulty %s.\n",
+           p->w, p->h, creek_diffnames[p->diff]);
+
+    while (1) {
+        desc = new_game_desc(p, rs, NULL, false);
+        st = new_game(NULL, p, desc);
+        if (grade_creek(st->clues, soln) != p->diff) {
+            printf("Misgraded: %s\n", desc);
+            nbad++;
+        }
+        free_game(st);
+        sfree(desc);
+
+        n++;
+
+        tt_last = time(NULL);
+        if (tt_last > tt_now) {
+            tt_now = tt_last;
+            printf("%d total, %3.1f/s; %d misgraded.\n",
+                   n, (double)n / ((double)tt_now - tt_start), nbad);
+        }
+    }
+}
+
+static long peak_rss_kb(void)
+{
+#ifdef HAVE_RUSAGE
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return -1;
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+static int compare_doubles(const void *av, const void *bv)
+{
+    double a = *(const double *)av, b = *(const double *)bv;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+/*
+ * Generate n puzzles at the given parameters and print a line of
+ * throughput, latency and solver effort figures.
+ */
+static void bench(game_params *p, random_state *rs, int n)
+{
+    double *lat = snewn(n, double), total = 0.0;
+    struct creek_stats st;
+    char *params;
+    int i;
+
+    check(p);
+
+    creek_get_stats(&st, true);
+    for (i = 0; i < n; i++) {
+        double t0 = stats_clock_creek();
+        char *desc = new_game_desc(p, rs, NULL, false);
+        lat[i] = stats_clock_creek() - t0;
+        total += lat[i];
+        sfree(desc);
+    }
+    qsort(lat, n, sizeof(double), compare_doubles);
+
+    params = encode_params(p, true);
+    creek_get_stats(&st, false);
+    printf("%-8s %6d %10.2f %10.3f %10.3f %12.1f %10ld\n", params, n,
+           total > 0 ? n / total : 0.0,
+           lat[(n-1) / 2] * 1000.0, lat[(n * 99 - 1) / 100] * 1000.0,
+           (double)(st.solves + st.probes) / n, peak_rss_kb());
+    fflush(stdout);
+    sfree(params);
+    sfree(lat);
+}
+
+/*
+ * Print the telemetry gathered since the last reset, and reset it.
+ */
+static void print_stats(void)
+{
+    struct creek_stats st;
+    int i;
+
+    creek_get_stats(&st, true);
+    printf("  %lu solves, %lu probe solves\n", st.solves, st.probes);
+    printf("  %-26s %10s %10s %10s\n", "technique", "tries", "hits", "ms");
+    for (i = 0; i < NTECH; i++)
+        printf("  %-26s %10lu %10lu %10.3f\n", creek_technames[i],
+               st.tries[i], st.hits[i], st.seconds[i] * 1000.0);
+    if (st.candidates)
+        printf("  %lu candidates: %lu too easy, %lu unsolved;"
+               " %.3f ms filling grids, %.3f ms removing clues\n",
+               st.candidates, st.too_easy, st.unsolved,
+               st.grid_seconds * 1000.0, st.removal_seconds * 1000.0);
+    fflush(stdout);
+}
+
+static void usage_exit(const char *msg)
+{
+    if (msg)
+        fprintf(stderr, "%s: %s\n", quis, msg);
+    fprintf(stderr, "Usage: %s [-v] [--stats] [--seed SEED] [-j THREADS]\n"
+            "           [--soak <params> | --bench [-n N] [<params> ...] |"
+            " <params> | <game_id> ...]\n", quis);
+    exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+    random_state *rs;
+    time_t seed = time(NULL);
+    bool do_soak = false, do_bench = false, verbose = false, stats = false;
+    int nbench = 20;
+    game_params *p;
+
+    quis = argv[0];
+    while (--argc > 0) {
+        const char *arg = *++argv;
+        if (!strcmp(arg, "--soak"))
+            do_soak = true;
+        else if (!strcmp(arg, "--bench"))
+            do_bench = true;
+        else if (!strcmp(arg, "-v"))
+            verbose = true;
+        else if (!strcmp(arg, "--stats"))
+            stats = true;
+        else if (!strcmp(arg, "--seed") || !strcmp(arg, "-n") ||
+                 !strcmp(arg, "-j")) {
+            if (argc < 2)
+                usage_exit("option needs an argument");
+            argc--;
+            argv++;
+            if (!strcmp(arg, "--seed"))
+                seed = (time_t)atoi(*argv);
+            else if (!strcmp(arg, "-n"))
+                nbench = atoi(*argv);
+#ifdef CREEK_PARALLEL
+            else
+                creek_generator_threads = atoi(*argv);
+#endif
+            if (nbench < 1)
+                usage_exit("-n needs a positive count");
+        } else if (*arg == '-')
+            usage_exit("unrecognised option");
+        else
+            break;
+    }
+    rs = random_new((void*)&seed, sizeof(time_t));
+
+    if (do_soak) {
+        if (argc != 1) usage_exit("only one argument for --soak");
+        p = default_params();
+        decode_params(p, *argv);
+        soak(p, rs);
+    } else if (do_bench) {
+        int i;
+
+        printf("%-8s %6s %10s %10s %10s %12s %10s\n", "params", "n",
+               "puzzles/s", "p50 ms", "p99 ms", "calls/puzzle", "rss KB");
+        if (argc == 0) {
+            for (i = 0; i < lenof(creek_presets); i++) {
+                p = dup_params(&creek_presets[i]);
+                bench(p, rs, nbench);
+                if (stats) print_stats();
+                free_params(p);
+            }
+        } else {
+            for (i = 0; i < argc; i++) {
+                p = default_params();
+                decode_params(p, argv[i]);
+                bench(p, rs, nbench);
+                if (stats) print_stats();
+                free_params(p);
+            }
+        }
+    } else if (argc > 0) {
+        int i;
+        for (i = 0; i < argc; i++) {
+            char *id = dupstr(argv[i]);
+            char *desc = strchr(id, ':');
+            const char *err;
+            p = default_params();
+            if (desc) {
+                *desc++ = '\0';
+                decode_params(p, id);
+                err = validate_params(p, true);
+                if (!err)
+                    err = validate_desc(p, desc);
+                if (err) {
+                    fprintf(stderr, "%s: %s\n", quis, err);
+                    exit(1);
+                }
+                solve(p, desc, verbose);
+            } else {
+                decode_params(p, id);
+                gen(p, rs, verbose);
+            }
+            if (stats) print_stats();
+            free_params(p);
+            sfree(id);
+        }
+    } else
+        usage_exit(NULL);
+
+    random_free(rs);
+    return 0;
+}
+
+#endif
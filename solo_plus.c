@@ -88,6 +88,11 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <stdint.h>
+
+#ifdef SOLO_PARALLEL
+#include <pthread.h>
+#endif
 
 #ifdef STANDALONE_SOLVER
 #include <stdarg.h>
@@ -99,14 +104,47 @@ int solver_show_working, solver_recurse_depth;
 /*
  * To save space, I store digits internally as unsigned char. This
  * imposes a hard limit of 255 on the order of the puzzle. Since
- * even a 5x5 takes unacceptably long to generate, I don't see this
- * as a serious limitation unless something _really_ impressive
- * happens in computing technology; but here's a typedef anyway for
- * general good practice.
+ * anything much beyond a 7x7 takes unacceptably long to generate, I
+ * don't see this as a serious limitation unless something _really_
+ * impressive happens in computing technology; but here's a typedef
+ * anyway for general good practice.
  */
 typedef unsigned char digit;
 #define ORDER_MAX 255
 
+/*
+ * Digits are shown and typed as 1-9 and then a-z, which runs out at
+ * 35; bigger puzzles go on to A-Z. (Smaller ones accept A-Z as
+ * synonyms for a-z.)
+ */
+#define SYMBOLS_MAX 61
+
+static char digit_char(int n)
+{
+    if (n <= 9)
+        return '0' + n;
+    else if (n <= 35)
+        return 'a' + n - 10;
+    else
+        return 'A' + n - 36;
+}
+
+/* The digit typed as c in a puzzle of order cr, or 0 if none. */
+static int char_digit(int c, int cr)
+{
+    int n;
+
+    if (c >= '1' && c <= '9')
+        n = c - '0';
+    else if (c >= 'a' && c <= 'z')
+        n = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'Z')
+        n = c - 'A' + (cr > 35 ? 36 : 10);
+    else
+        return 0;
+    return n <= cr ? n : 0;
+}
+
 #define PREFERRED_TILE_SIZE 48
 #define TILE_SIZE (ds->tilesize)
 #define BORDER (TILE_SIZE / 2)
@@ -236,9 +274,12 @@ struct block_structure {
      *
      * nr_squares may be NULL for block structures where all blocks are
      * the same size.
+     *
+     * max_nr_blocks is the number of blocks there is room for, which
+     * split_block() uses up before it has to reallocate.
      */
     int *whichblock, **blocks, *nr_squares, *blocks_data;
-    int nr_blocks, max_nr_squares;
+    int nr_blocks, max_nr_squares, max_nr_blocks;
 
 #ifdef STANDALONE_SOLVER
     /*
@@ -527,8 +568,8 @@ static const char *validate_params(const game_params *params, bool full)
         return "Both dimensions must be at least 2";
     if (params->c > ORDER_MAX || params->r > ORDER_MAX)
         return "Dimensions greater than "STR(ORDER_MAX)" are not supported";
-    if ((params->c * params->r) > 31)
-        return "Unable to support more than 31 distinct symbols in a puzzle";
+    if ((params->c * params->r) > SYMBOLS_MAX)
+        return "Unable to support more than "STR(SYMBOLS_MAX)" distinct symbols in a puzzle";
     if (params->killer && params->c * params->r > 9)
         return "Killer puzzle dimensions must be smaller than 10";
     if (params->xtype && params->c * params->r < 4)
@@ -549,7 +590,7 @@ static struct block_structure *alloc_block_structure(int c, int r, int area,
     struct block_structure *b = snew(struct block_structure);
 
     b->refcount = 1;
-    b->nr_blocks = nr_blocks;
+    b->nr_blocks = b->max_nr_blocks = nr_blocks;
     b->max_nr_squares = max_nr_squares;
     b->c = c; b->r = r; b->area = area;
     b->whichblock = snewn(area, int);
@@ -582,13 +623,19 @@ static void free_block_structure(struct block_structure *b)
     }
 }
 
-static struct block_structure *dup_block_structure(struct block_structure *b)
+/*
+ * Copy a block structure, leaving room for it to grow to at least
+ * max_nr_blocks blocks.
+ */
+static struct block_structure *dup_block_structure_room(
+    struct block_structure *b, int max_nr_blocks)
 {
     struct block_structure *nb;
     int i;
 
     nb = alloc_block_structure(b->c, b->r, b->area, b->max_nr_squares,
-                               b->nr_blocks);
+                               max(b->nr_blocks, max_nr_blocks));
+    nb->nr_blocks = b->nr_blocks;
     memcpy(nb->nr_squares, b->nr_squares, b->nr_blocks * sizeof *b->nr_squares);
     memcpy(nb->whichblock, b->whichblock, b->area * sizeof *b->whichblock);
     memcpy(nb->blocks_data, b->blocks_data,
@@ -610,6 +657,11 @@ static struct block_structure *dup_block_structure(struct block_structure *b)
     return nb;
 }
 
+static struct block_structure *dup_block_structure(struct block_structure *b)
+{
+    return dup_block_structure_room(b, b->nr_blocks);
+}
+
 static void split_block(struct block_structure *b, int *squares, int nr_squares)
 {
     int i, j;
@@ -620,13 +672,16 @@ static void split_block(struct block_structure *b, int *squares, int nr_squares)
     assert(b->nr_squares[previous_block] > nr_squares);
 
     b->nr_blocks++;
-    b->blocks_data = sresize(b->blocks_data,
-                             b->nr_blocks * b->max_nr_squares, int);
-    b->nr_squares = sresize(b->nr_squares, b->nr_blocks, int);
-    sfree(b->blocks);
-    b->blocks = snewn(b->nr_blocks, int *);
-    for (i = 0; i < b->nr_blocks; i++)
-        b->blocks[i] = b->blocks_data + i*b->max_nr_squares;
+    if (b->nr_blocks > b->max_nr_blocks) {
+        b->max_nr_blocks = b->nr_blocks;
+        b->blocks_data = sresize(b->blocks_data,
+                                 b->nr_blocks * b->max_nr_squares, int);
+        b->nr_squares = sresize(b->nr_squares, b->nr_blocks, int);
+        sfree(b->blocks);
+        b->blocks = snewn(b->nr_blocks, int *);
+        for (i = 0; i < b->nr_blocks; i++)
+            b->blocks[i] = b->blocks_data + i*b->max_nr_squares;
+    }
     for (i = 0; i < nr_squares; i++) {
         assert(b->whichblock[squares[i]] == previous_block);
         b->whichblock[squares[i]] = newblock;
@@ -723,18 +778,86 @@ static void remove_from_block(struct block_structure *blocks, int b, int n)
  *    get any further.
  */
 
+/*
+ * The solver keeps its candidates as bit sets, one machine word per
+ * square (or per digit within a region), so that the elimination
+ * rules reduce to masking, counting set bits and finding the lowest
+ * one.
+ */
+typedef uint64_t candmask;
+#define MASKBIT(i) ((candmask)1 << (i))
+
+static int bitcount(candmask m)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(m);
+#else
+    int count = 0;
+    while (m) {
+        m &= m - 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+/* Index of the lowest set bit of a non-zero mask. */
+static int lowest_bit(candmask m)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(m);
+#else
+    int i = 0;
+    assert(m);
+    while (!(m & 1)) {
+        m >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/* Index of the highest set bit of a non-zero mask. */
+static int highest_bit(candmask m)
+{
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(m);
+#else
+    int i = -1;
+    assert(m);
+    while (m) {
+        m >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
 struct solver_usage {
     int cr;
     struct block_structure *blocks, *kblocks, *extra_cages;
     /*
-     * We set up a cubic array, indexed by x, y and digit; each
-     * element of this array is true or false according to whether
-     * or not that digit _could_ in principle go in that position.
+     * Conceptually we have a cubic array, indexed by x, y and digit;
+     * each element is true or false according to whether or not that
+     * digit _could_ in principle go in that position. We store it
+     * twice over, as bit sets along each of the two directions the
+     * solver cares about:
+     *
+     *  - cand[y*cr+x] has bit n-1 set if n could go at (x,y).
      *
-     * The way to index this array is cube[(y*cr+x)*cr+n-1]; there
-     * are macros below to help with this.
+     *  - rowpos[y*cr+n-1] has bit x set if n could go at (x,y);
+     *    colpos[x*cr+n-1] likewise has bit y set; blkpos[i*cr+n-1]
+     *    has bit j set if n could go in blocks->blocks[i][j]; and
+     *    diagpos[i*cr+n-1] has bit j set if n could go at the jth
+     *    square of diagonal i.
+     *
+     * Only solver_rule_out() clears bits, and it keeps all the views
+     * in step.
      */
-    bool *cube;
+    candmask *cand;
+    candmask *rowpos, *colpos, *blkpos, *diagpos;
+    /* blkindex[y*cr+x] is the position of (x,y) within its block */
+    int *blkindex;
     /*
      * This is the grid in which we write down our final
      * deductions. y-coordinates in here are _not_ transformed.
@@ -745,6 +868,13 @@ struct solver_usage {
      * each cage.  For derived cages, the clue is in extra_clues.
      */
     digit *kclues, *extra_clues;
+    /*
+     * The cages and cage clues we were given, before deduction split
+     * them up. Complete grids found by guessing are checked against
+     * these.
+     */
+    struct block_structure *orig_kblocks;
+    digit *kgrid;
     /*
      * Now we keep track, at a slightly higher level, of what we
      * have yet to work out, to prevent doing the same deduction
@@ -759,20 +889,68 @@ struct solver_usage {
     /* diag[i*cr+n-1] true if digit n has been placed in diagonal i */
     bool *diag;                        /* diag 0 is \, 1 is / */
 
+    /*
+     * The squares of each row, column and block (and, for X
+     * puzzles, diagonal) in order.
+     */
     int *regions;
     int nr_regions;
     int **sq2region;
+
+    /*
+     * When the solver is allowed to guess, every change it makes to
+     * the candidates and the grid is logged here so that a guess can
+     * be rolled back. An entry xy*cr+n-1 means n was ruled out at
+     * square xy; an entry -1-xy means square xy was filled in. NULL
+     * if we are not going to backtrack.
+     */
+    int *trail, ntrail;
+    /*
+     * The first complete grid the search found, and how many it has
+     * found so far (it stops at two).
+     */
+    digit *solution;
+    int nsolutions;
 };
-#define cubepos2(xy,n) ((xy)*usage->cr+(n)-1)
-#define cubepos(x,y,n) cubepos2((y)*usage->cr+(x),n)
-#define cube(x,y,n) (usage->cube[cubepos(x,y,n)])
-#define cube2(xy,n) (usage->cube[cubepos2(xy,n)])
+#define cand(x,y,n) (usage->cand[(y)*usage->cr+(x)] & MASKBIT((n)-1))
+#define cand2(xy,n) (usage->cand[xy] & MASKBIT((n)-1))
+#define rowcells(y) (usage->regions + (y)*cr*3)
+#define colcells(x) (usage->regions + (x)*cr*3 + cr)
+#define diagcells(i) (usage->regions + cr*cr*3 + (i)*cr)
 
 #define ondiag0(xy) ((xy) % (cr+1) == 0)
 #define ondiag1(xy) ((xy) % (cr-1) == 0 && (xy) > 0 && (xy) < cr*cr-1)
 #define diag0(i) ((i) * (cr+1))
 #define diag1(i) ((i+1) * (cr-1))
 
+/*
+ * Rule out digit n at square xy, in every view of the cube. Returns
+ * true if it was still a possibility.
+ */
+static bool solver_rule_out(struct solver_usage *usage, int xy, int n)
+{
+    int cr = usage->cr;
+    int x = xy % cr, y = xy / cr;
+
+    if (!cand2(xy, n))
+        return false;
+
+    if (usage->trail)
+        usage->trail[usage->ntrail++] = xy*cr+n-1;
+    usage->cand[xy] &= ~MASKBIT(n-1);
+    usage->rowpos[y*cr+n-1] &= ~MASKBIT(x);
+    usage->colpos[x*cr+n-1] &= ~MASKBIT(y);
+    usage->blkpos[usage->blocks->whichblock[xy]*cr+n-1] &=
+        ~MASKBIT(usage->blkindex[xy]);
+    if (usage->diag) {
+        if (ondiag0(xy))
+            usage->diagpos[n-1] &= ~MASKBIT(xy / (cr+1));
+        if (ondiag1(xy))
+            usage->diagpos[cr+n-1] &= ~MASKBIT(xy / (cr-1) - 1);
+    }
+    return true;
+}
+
 /*
  * Function called when we are certain that a particular square has
  * a particular number in it. The y-coordinate passed in here is
@@ -782,45 +960,43 @@ static void solver_place(struct solver_usage *usage, int x, int y, int n)
 {
     int cr = usage->cr;
     int sqindex = y*cr+x;
-    int i, bi;
+    int bi;
+    candmask m;
 
-    assert(cube(x,y,n));
+    assert(cand(x,y,n));
 
     /*
      * Rule out all other numbers in this square.
      */
-    for (i = 1; i <= cr; i++)
-        if (i != n)
-            cube(x,y,i) = false;
+    for (m = usage->cand[sqindex] & ~MASKBIT(n-1); m; m &= m - 1)
+        solver_rule_out(usage, sqindex, 1 + lowest_bit(m));
 
     /*
      * Rule out this number in all other positions in the row.
      */
-    for (i = 0; i < cr; i++)
-        if (i != y)
-            cube(x,i,n) = false;
+    for (m = usage->rowpos[y*cr+n-1] & ~MASKBIT(x); m; m &= m - 1)
+        solver_rule_out(usage, y*cr+lowest_bit(m), n);
 
     /*
      * Rule out this number in all other positions in the column.
      */
-    for (i = 0; i < cr; i++)
-        if (i != x)
-            cube(i,y,n) = false;
+    for (m = usage->colpos[x*cr+n-1] & ~MASKBIT(y); m; m &= m - 1)
+        solver_rule_out(usage, lowest_bit(m)*cr+x, n);
 
     /*
      * Rule out this number in all other positions in the block.
      */
     bi = usage->blocks->whichblock[sqindex];
-    for (i = 0; i < cr; i++) {
-        int bp = usage->blocks->blocks[bi][i];
-        if (bp != sqindex)
-            cube2(bp,n) = false;
-    }
+    for (m = usage->blkpos[bi*cr+n-1] & ~MASKBIT(usage->blkindex[sqindex]);
+         m; m &= m - 1)
+        solver_rule_out(usage, usage->blocks->blocks[bi][lowest_bit(m)], n);
 
     /*
      * Enter the number in the result grid.
      */
     usage->grid[sqindex] = n;
+    if (usage->trail)
+        usage->trail[usage->ntrail++] = -1-sqindex;
 
     /*
      * Cross out this number from the list of numbers left to place
@@ -831,20 +1007,63 @@ static void solver_place(struct solver_usage *usage, int x, int y, int n)
 
     if (usage->diag) {
         if (ondiag0(sqindex)) {
-            for (i = 0; i < cr; i++)
-                if (diag0(i) != sqindex)
-                    cube2(diag0(i),n) = false;
+            for (m = usage->diagpos[n-1] & ~MASKBIT(sqindex / (cr+1));
+                 m; m &= m - 1)
+                solver_rule_out(usage, diag0(lowest_bit(m)), n);
             usage->diag[n-1] = true;
         }
         if (ondiag1(sqindex)) {
-            for (i = 0; i < cr; i++)
-                if (diag1(i) != sqindex)
-                    cube2(diag1(i),n) = false;
+            for (m = usage->diagpos[cr+n-1] & ~MASKBIT(sqindex / (cr-1) - 1);
+                 m; m &= m - 1)
+                solver_rule_out(usage, diag1(lowest_bit(m)), n);
             usage->diag[cr+n-1] = true;
         }
     }
 }
 
+/*
+ * Roll the trail back to an earlier length, undoing every placement
+ * and elimination made since.
+ */
+static void solver_undo(struct solver_usage *usage, int mark)
+{
+    int cr = usage->cr;
+
+    while (usage->ntrail > mark) {
+        int t = usage->trail[--usage->ntrail];
+
+        if (t >= 0) {
+            int xy = t / cr, n = t % cr + 1;
+            int x = xy % cr, y = xy / cr;
+
+            usage->cand[xy] |= MASKBIT(n-1);
+            usage->rowpos[y*cr+n-1] |= MASKBIT(x);
+            usage->colpos[x*cr+n-1] |= MASKBIT(y);
+            usage->blkpos[usage->blocks->whichblock[xy]*cr+n-1] |=
+                MASKBIT(usage->blkindex[xy]);
+            if (usage->diag) {
+                if (ondiag0(xy))
+                    usage->diagpos[n-1] |= MASKBIT(xy / (cr+1));
+                if (ondiag1(xy))
+                    usage->diagpos[cr+n-1] |= MASKBIT(xy / (cr-1) - 1);
+            }
+        } else {
+            int xy = -1-t, n = usage->grid[xy];
+            int x = xy % cr, y = xy / cr;
+
+            usage->grid[xy] = 0;
+            usage->row[y*cr+n-1] = usage->col[x*cr+n-1] =
+                usage->blk[usage->blocks->whichblock[xy]*cr+n-1] = false;
+            if (usage->diag) {
+                if (ondiag0(xy))
+                    usage->diag[n-1] = false;
+                if (ondiag1(xy))
+                    usage->diag[cr+n-1] = false;
+            }
+        }
+    }
+}
+
 #if defined STANDALONE_SOLVER && defined __GNUC__
 /*
  * Forward-declare the functions taking printf-like format arguments
@@ -852,47 +1071,46 @@ static void solver_place(struct solver_usage *usage, int x, int y, int n)
  * gets debugged.
  */
 struct solver_scratch;
-static int solver_elim(struct solver_usage *usage, int *indices,
+static int solver_elim(struct solver_usage *usage, candmask bits,
+                       const int *cells, int xy, int n,
                        const char *fmt, ...)
-    __attribute__((format(printf,3,4)));
-static int solver_intersect(struct solver_usage *usage,
-                            int *indices1, int *indices2, const char *fmt, ...)
-    __attribute__((format(printf,4,5)));
+    __attribute__((format(printf,6,7)));
+static int solver_intersect(struct solver_usage *usage, int n,
+                            candmask bits1, candmask overlap1,
+                            candmask bits2, candmask overlap2,
+                            const int *cells2, const char *fmt, ...)
+    __attribute__((format(printf,8,9)));
 static int solver_set(struct solver_usage *usage,
                       struct solver_scratch *scratch,
-                      int *indices, const char *fmt, ...)
-    __attribute__((format(printf,4,5)));
+                      const int *cells, int n, const char *fmt, ...)
+    __attribute__((format(printf,5,6)));
 #endif
 
-static int solver_elim(struct solver_usage *usage, int *indices
+/*
+ * Look at one line through the cube. If cells is non-NULL, bit i of
+ * `bits' says whether digit n can go in square cells[i]; otherwise
+ * bit i says whether digit i+1 can go in square xy. A line with a
+ * single possibility left is a placement; one with none left is a
+ * contradiction.
+ */
+static int solver_elim(struct solver_usage *usage, candmask bits,
+                       const int *cells, int xy, int n
 #ifdef STANDALONE_SOLVER
                        , const char *fmt, ...
 #endif
                        )
 {
     int cr = usage->cr;
-    int fpos, m, i;
-
-    /*
-     * Count the number of set bits within this section of the
-     * cube.
-     */
-    m = 0;
-    fpos = -1;
-    for (i = 0; i < cr; i++)
-        if (usage->cube[indices[i]]) {
-            fpos = indices[i];
-            m++;
-        }
 
-    if (m == 1) {
-        int x, y, n;
-        assert(fpos >= 0);
+    if (bits && !(bits & (bits - 1))) {
+        int x, y;
 
-        n = 1 + fpos % cr;
-        x = fpos / cr;
-        y = x / cr;
-        x %= cr;
+        if (cells)
+            xy = cells[lowest_bit(bits)];
+        else
+            n = 1 + lowest_bit(bits);
+        x = xy % cr;
+        y = xy / cr;
 
         if (!usage->grid[y*cr+x]) {
 #ifdef STANDALONE_SOLVER
@@ -909,7 +1127,7 @@ static int solver_elim(struct solver_usage *usage, int *indices
             solver_place(usage, x, y, n);
             return +1;
         }
-    } else if (m == 0) {
+    } else if (!bits) {
 #ifdef STANDALONE_SOLVER
         if (solver_show_working) {
             va_list ap;
@@ -927,117 +1145,146 @@ static int solver_elim(struct solver_usage *usage, int *indices
     return 0;
 }
 
-static int solver_intersect(struct solver_usage *usage,
-                            int *indices1, int *indices2
+/*
+ * Intersect two domains for the same digit n. bits1 and bits2 are
+ * the digit's possible positions within each domain, and overlap1
+ * and overlap2 are the positions they share, in each domain's own
+ * numbering. If every possibility in the first domain lies in the
+ * overlap, then n can be ruled out of the rest of the second domain,
+ * whose squares are listed in cells2.
+ */
+static int solver_intersect(struct solver_usage *usage, int n,
+                            candmask bits1, candmask overlap1,
+                            candmask bits2, candmask overlap2,
+                            const int *cells2
 #ifdef STANDALONE_SOLVER
                             , const char *fmt, ...
 #endif
                             )
 {
-    int cr = usage->cr;
-    int ret, i, j;
+    candmask m;
 
-    /*
-     * Loop over the first domain and see if there's any set bit
-     * not also in the second.
-     */
-    for (i = j = 0; i < cr; i++) {
-        int p = indices1[i];
-        while (j < cr && indices2[j] < p)
-            j++;
-        if (usage->cube[p]) {
-            if (j < cr && indices2[j] == p)
-                continue;               /* both domains contain this index */
-            else
-                return 0;               /* there is, so we can't deduce */
-        }
-    }
+    if (bits1 & ~overlap1)
+        return 0;
+    m = bits2 & ~overlap2;
+    if (!m)
+        return 0;
 
-    /*
-     * We have determined that all set bits in the first domain are
-     * within its overlap with the second. So loop over the second
-     * domain and remove all set bits that aren't also in that
-     * overlap; return +1 iff we actually _did_ anything.
-     */
-    ret = 0;
-    for (i = j = 0; i < cr; i++) {
-        int p = indices2[i];
-        while (j < cr && indices1[j] < p)
-            j++;
-        if (usage->cube[p] && (j >= cr || indices1[j] != p)) {
 #ifdef STANDALONE_SOLVER
-            if (solver_show_working) {
-                int px, py, pn;
-
-                if (!ret) {
-                    va_list ap;
-                    printf("%*s", solver_recurse_depth*4, "");
-                    va_start(ap, fmt);
-                    vprintf(fmt, ap);
-                    va_end(ap);
-                    printf(":\n");
-                }
-
-                pn = 1 + p % cr;
-                px = p / cr;
-                py = px / cr;
-                px %= cr;
+    if (solver_show_working) {
+        va_list ap;
+        printf("%*s", solver_recurse_depth*4, "");
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+        printf(":\n");
+    }
+#endif
 
-                printf("%*s  ruling out %d at (%d,%d)\n",
-                       solver_recurse_depth*4, "", pn, 1+px, 1+py);
-            }
+    for (; m; m &= m - 1) {
+        int p = cells2[lowest_bit(m)];
+#ifdef STANDALONE_SOLVER
+        if (solver_show_working)
+            printf("%*s  ruling out %d at (%d,%d)\n",
+                   solver_recurse_depth*4, "", n,
+                   1 + p % usage->cr, 1 + p / usage->cr);
 #endif
-            ret = +1;                       /* we did something */
-            usage->cube[p] = false;
-        }
+        solver_rule_out(usage, p, n);
     }
 
-    return ret;
+    return +1;
 }
 
 struct solver_scratch {
-    unsigned char *grid, *rowidx, *colidx, *set;
+    unsigned char *grid, *rowidx, *colidx;
+    candmask *setrows;
     int *neighbours, *bfsqueue;
-    int *indexlist, *indexlist2;
+    int *linepos;
+    /* killer cages saved by the search, cagesavesize ints per level */
+    int *cagesave, cagesavesize;
+    digit *cluesave;
 #ifdef STANDALONE_SOLVER
     int *bfsprev;
 #endif
 };
 
+/*
+ * Set elimination looks at every subset of the undecided columns of
+ * a region, which is fine up to the 25-symbol grids but hopeless for
+ * the wider regions of 6x6 and 7x7 puzzles. Above SET_FULL_NR
+ * columns we only try sets of at most SET_MAX_SIZE columns and their
+ * complements, which still finds every naked or hidden subset of up
+ * to SET_MAX_SIZE squares.
+ */
+#define SET_FULL_NR 25
+#define SET_MAX_SIZE 3
+
+/*
+ * Step to the next candidate column set after `set', or return 0
+ * when there are none left. Narrow regions count upwards through
+ * every subset; wide ones walk through the sets of each permitted
+ * size in increasing numeric order.
+ */
+static candmask solver_set_next(candmask set, int nr)
+{
+    candmask low, ripple;
+    int count;
+
+    if (nr <= SET_FULL_NR)
+        return set + 1 < MASKBIT(nr) ? set + 1 : 0;
+
+    if (!set)
+        return MASKBIT(2) - 1;
+
+    /* Next set of the same size (Gosper's hack). */
+    low = set & -set;
+    ripple = set + low;
+    ripple |= ((ripple ^ set) >> 2) / low;
+    if (ripple < MASKBIT(nr))
+        return ripple;
+
+    count = bitcount(set) + 1;
+    if (count > SET_MAX_SIZE && count < nr - SET_MAX_SIZE)
+        count = nr - SET_MAX_SIZE;
+    return count < nr - 1 ? MASKBIT(count) - 1 : 0;
+}
+
 static int solver_set(struct solver_usage *usage,
                       struct solver_scratch *scratch,
-                      int *indices
+                      const int *cells, int n
 #ifdef STANDALONE_SOLVER
                       , const char *fmt, ...
 #endif
                       )
 {
     int cr = usage->cr;
-    int i, j, n, count;
-    unsigned char *grid = scratch->grid;
+    int i, j, nr;
     unsigned char *rowidx = scratch->rowidx;
     unsigned char *colidx = scratch->colidx;
-    unsigned char *set = scratch->set;
+    candmask *rows = scratch->setrows;
+    candmask set;
 
     /*
-     * We are passed a cr-by-cr matrix of booleans. Our first job
-     * is to winnow it by finding any definite placements - i.e.
-     * any row with a solitary 1 - and discarding that row and the
-     * column containing the 1.
+     * We are passed a cr-by-cr matrix of booleans, one bit set per
+     * row. If cells is non-NULL, row i is the square cells[i] and
+     * its columns are digits; otherwise row i is row i of the grid,
+     * its columns are x-coordinates, and the matrix is the set of
+     * positions for digit n.
+     *
+     * Our first job is to winnow it by finding any definite
+     * placements - i.e. any row with a solitary 1 - and discarding
+     * that row and the column containing the 1.
      */
     memset(rowidx, 1, cr);
     memset(colidx, 1, cr);
     for (i = 0; i < cr; i++) {
-        int count = 0, first = -1;
-        for (j = 0; j < cr; j++)
-            if (usage->cube[indices[i*cr+j]])
-                first = j, count++;
+        candmask m = cells ? usage->cand[cells[i]] : usage->rowpos[i*cr+n-1];
 
         /*
-         * If count == 0, then there's a row with no 1s at all and
-         * the puzzle is internally inconsistent.
+         * If there are no 1s at all in this row, then the puzzle
+         * is internally inconsistent.
          */
-        if (count == 0) {
+        if (!m) {
 #ifdef STANDALONE_SOLVER
             if (solver_show_working) {
                 va_list ap;
@@ -1052,8 +1299,8 @@ static int solver_set(struct solver_usage *usage,
 #endif
             return -1;
         }
-        if (count == 1)
-            rowidx[i] = colidx[first] = 0;
+        if (!(m & (m - 1)))
+            rowidx[i] = colidx[lowest_bit(m)] = 0;
     }
 
     /*
@@ -1063,148 +1310,132 @@ static int solver_set(struct solver_usage *usage,
     for (i = j = 0; i < cr; i++)
         if (rowidx[i])
             rowidx[j++] = i;
-    n = j;
+    nr = j;
     for (i = j = 0; i < cr; i++)
         if (colidx[i])
             colidx[j++] = i;
-    assert(n == j);
+    assert(nr == j);
 
     /*
-     * And create the smaller matrix.
+     * And create the smaller matrix, with column j of it as bit
+     * nr-1-j so that counting upwards visits the candidate column
+     * sets in the same order as a binary increment over the column
+     * list.
      */
-    for (i = 0; i < n; i++)
-        for (j = 0; j < n; j++)
-            grid[i*cr+j] = usage->cube[indices[rowidx[i]*cr+colidx[j]]];
+    for (i = 0; i < nr; i++) {
+        candmask m = cells ? usage->cand[cells[rowidx[i]]] :
+            usage->rowpos[rowidx[i]*cr+n-1];
+        rows[i] = 0;
+        for (j = 0; j < nr; j++)
+            if (m & MASKBIT(colidx[j]))
+                rows[i] |= MASKBIT(nr-1-j);
+    }
 
     /*
      * Having done that, we now have a matrix in which every row
      * has at least two 1s in. Now we search to see if we can find
      * a rectangle of zeroes (in the set-theoretic sense of
      * `rectangle', i.e. a subset of rows crossed with a subset of
-     * columns) whose width and height add up to n.
+     * columns) whose width and height add up to nr.
      */
+    assert(nr < 64);
+    for (set = solver_set_next(0, nr); set; set = solver_set_next(set, nr)) {
+        int count = bitcount(set), nrows;
 
-    memset(set, 0, n);
-    count = 0;
-    while (1) {
         /*
-         * We have a candidate set. If its size is <=1 or >=n-1
-         * then we move on immediately.
+         * If the candidate set's size is <=1 or >=nr-1 then we
+         * move on immediately.
          */
-        if (count > 1 && count < n-1) {
-            /*
-             * The number of rows we need is n-count. See if we can
-             * find that many rows which each have a zero in all
-             * the positions listed in `set'.
-             */
-            int rows = 0;
-            for (i = 0; i < n; i++) {
-                bool ok = true;
-                for (j = 0; j < n; j++)
-                    if (set[j] && grid[i*cr+j]) {
-                        ok = false;
-                        break;
-                    }
-                if (ok)
-                    rows++;
-            }
+        if (count <= 1 || count >= nr-1)
+            continue;
 
-            /*
-             * We expect never to be able to get _more_ than
-             * n-count suitable rows: this would imply that (for
-             * example) there are four numbers which between them
-             * have at most three possible positions, and hence it
-             * indicates a faulty deduction before this point or
-             * even a bogus clue.
-             */
-            if (rows > n - count) {
+        /*
+         * The number of rows we need is nr-count. See if we can
+         * find that many rows which each have a zero in all the
+         * positions listed in `set'.
+         */
+        nrows = 0;
+        for (i = 0; i < nr; i++)
+            if (!(rows[i] & set))
+                nrows++;
+
+        /*
+         * We expect never to be able to get _more_ than nr-count
+         * suitable rows: this would imply that (for example)
+         * there are four numbers which between them have at most
+         * three possible positions, and hence it indicates a
+         * faulty deduction before this point or even a bogus clue.
+         */
+        if (nrows > nr - count) {
 #ifdef STANDALONE_SOLVER
-                if (solver_show_working) {
-                    va_list ap;
-                    printf("%*s", solver_recurse_depth*4,
-                           "");
-                    va_start(ap, fmt);
-                    vprintf(fmt, ap);
-                    va_end(ap);
-                    printf(":\n%*s  contradiction reached\n",
-                           solver_recurse_depth*4, "");
-                }
-#endif
-                return -1;
+            if (solver_show_working) {
+                va_list ap;
+                printf("%*s", solver_recurse_depth*4,
+                       "");
+                va_start(ap, fmt);
+                vprintf(fmt, ap);
+                va_end(ap);
+                printf(":\n%*s  contradiction reached\n",
+                       solver_recurse_depth*4, "");
             }
+#endif
+            return -1;
+        }
 
-            if (rows >= n - count) {
-                bool progress = false;
+        if (nrows >= nr - count) {
+            bool progress = false;
 
-                /*
-                 * We've got one! Now, for each row which _doesn't_
-                 * satisfy the criterion, eliminate all its set
-                 * bits in the positions _not_ listed in `set'.
-                 * Return +1 (meaning progress has been made) if we
-                 * successfully eliminated anything at all.
-                 * 
-                 * This involves referring back through
-                 * rowidx/colidx in order to work out which actual
-                 * positions in the cube to meddle with.
-                 */
-                for (i = 0; i < n; i++) {
-                    bool ok = true;
-                    for (j = 0; j < n; j++)
-                        if (set[j] && grid[i*cr+j]) {
-                            ok = false;
-                            break;
+            /*
+             * We've got one! Now, for each row which _doesn't_
+             * satisfy the criterion, eliminate all its set bits in
+             * the positions _not_ listed in `set'. Return +1
+             * (meaning progress has been made) if we successfully
+             * eliminated anything at all.
+             *
+             * This involves referring back through rowidx/colidx
+             * in order to work out which actual positions in the
+             * cube to meddle with.
+             */
+            for (i = 0; i < nr; i++) {
+                if (!(rows[i] & set))
+                    continue;
+                for (j = 0; j < nr; j++)
+                    if (rows[i] & ~set & MASKBIT(nr-1-j)) {
+                        int xy, dn;
+
+                        if (cells) {
+                            xy = cells[rowidx[i]];
+                            dn = colidx[j] + 1;
+                        } else {
+                            xy = rowidx[i]*cr + colidx[j];
+                            dn = n;
                         }
-                    if (!ok) {
-                        for (j = 0; j < n; j++)
-                            if (!set[j] && grid[i*cr+j]) {
-                                int fpos = indices[rowidx[i]*cr+colidx[j]];
 #ifdef STANDALONE_SOLVER
-                                if (solver_show_working) {
-                                    int px, py, pn;
-
-                                    if (!progress) {
-                                        va_list ap;
-                                        printf("%*s", solver_recurse_depth*4,
-                                               "");
-                                        va_start(ap, fmt);
-                                        vprintf(fmt, ap);
-                                        va_end(ap);
-                                        printf(":\n");
-                                    }
-
-                                    pn = 1 + fpos % cr;
-                                    px = fpos / cr;
-                                    py = px / cr;
-                                    px %= cr;
+                        if (solver_show_working) {
+                            if (!progress) {
+                                va_list ap;
+                                printf("%*s", solver_recurse_depth*4,
+                                       "");
+                                va_start(ap, fmt);
+                                vprintf(fmt, ap);
+                                va_end(ap);
+                                printf(":\n");
+                            }
 
-                                    printf("%*s  ruling out %d at (%d,%d)\n",
-                                           solver_recurse_depth*4, "",
-                                           pn, 1+px, 1+py);
-                                }
+                            printf("%*s  ruling out %d at (%d,%d)\n",
+                                   solver_recurse_depth*4, "",
+                                   dn, 1 + xy % cr, 1 + xy / cr);
+                        }
 #endif
-                                progress = true;
-                                usage->cube[fpos] = false;
-                            }
+                        progress = true;
+                        solver_rule_out(usage, xy, dn);
                     }
-                }
+            }
 
-                if (progress) {
-                    return +1;
-                }
+            if (progress) {
+                return +1;
             }
         }
-
-        /*
-         * Binary increment: change the rightmost 0 to a 1, and
-         * change all 1s to the right of it to 0s.
-         */
-        i = n;
-        while (i > 0 && set[i-1])
-            set[--i] = 0, count--;
-        if (i > 0)
-            set[--i] = 1, count++;
-        else
-            break;                     /* done */
     }
 
     return 0;
@@ -1260,28 +1491,21 @@ static int solver_forcing(struct solver_usage *usage,
 
     for (y = 0; y < cr; y++)
         for (x = 0; x < cr; x++) {
-            int count, t, n;
+            candmask pair = usage->cand[y*cr+x];
+            int n;
 
             /*
              * If this square doesn't have exactly two candidate
              * numbers, don't try it.
-             * 
-             * In this loop we also sum the candidate numbers,
-             * which is a nasty hack to allow us to quickly find
-             * `the other one' (since we will shortly know there
-             * are exactly two).
              */
-            for (count = t = 0, n = 1; n <= cr; n++)
-                if (cube(x, y, n))
-                    count++, t += n;
-            if (count != 2)
+            if (bitcount(pair) != 2)
                 continue;
 
             /*
              * Now attempt a bfs for each candidate.
              */
             for (n = 1; n <= cr; n++)
-                if (cube(x, y, n)) {
+                if (pair & MASKBIT(n-1)) {
                     int orign, currn, head, tail;
 
                     /*
@@ -1295,7 +1519,7 @@ static int solver_forcing(struct solver_usage *usage,
 #ifdef STANDALONE_SOLVER
                     bfsprev[y*cr+x] = -1;
 #endif
-                    number[y*cr+x] = t - n;
+                    number[y*cr+x] = 1 + lowest_bit(pair & ~MASKBIT(n-1));
 
                     while (head < tail) {
                         int xx, yy, nneighbours, xt, yt, i;
@@ -1333,7 +1557,7 @@ static int solver_forcing(struct solver_usage *usage,
                          * Try visiting each of those neighbours.
                          */
                         for (i = 0; i < nneighbours; i++) {
-                            int cc, tt, nn;
+                            candmask other;
 
                             xt = neighbours[i] % cr;
                             yt = neighbours[i] / cr;
@@ -1345,7 +1569,7 @@ static int solver_forcing(struct solver_usage *usage,
                              */
                             if (number[yt*cr+xt] <= cr)
                                 continue;
-                            if (!cube(xt, yt, currn))
+                            if (!cand(xt, yt, currn))
                                 continue;
 
                             /*
@@ -1360,15 +1584,14 @@ static int solver_forcing(struct solver_usage *usage,
                              * this square to have exactly two
                              * possible numbers.
                              */
-                            for (cc = tt = 0, nn = 1; nn <= cr; nn++)
-                                if (cube(xt, yt, nn))
-                                    cc++, tt += nn;
-                            if (cc == 2) {
+                            other = usage->cand[yt*cr+xt];
+                            if (bitcount(other) == 2) {
                                 bfsqueue[tail++] = yt*cr+xt;
 #ifdef STANDALONE_SOLVER
                                 bfsprev[yt*cr+xt] = yy*cr+xx;
 #endif
-                                number[yt*cr+xt] = tt - currn;
+                                number[yt*cr+xt] =
+                                    1 + lowest_bit(other & ~MASKBIT(currn-1));
                             }
 
                             /*
@@ -1406,7 +1629,7 @@ static int solver_forcing(struct solver_usage *usage,
                                            orign, 1+xt, 1+yt);
                                 }
 #endif
-                                cube(xt, yt, orign) = false;
+                                solver_rule_out(usage, yt*cr+xt, orign);
                                 return 1;
                             }
                         }
@@ -1435,29 +1658,21 @@ static int solver_killer_minmax(struct solver_usage *usage,
 
     for (i = 0; i < nsquares; i++) {
         int n, x = cages->blocks[b][i];
+        int maxval = 0, minval = 0;
+        int j;
+
+        for (j = 0; j < nsquares; j++) {
+            candmask m = usage->cand[cages->blocks[b][j]];
+            if (i == j || !m)
+                continue;
+            minval += 1 + lowest_bit(m);
+            maxval += 1 + highest_bit(m);
+        }
 
         for (n = 1; n <= cr; n++)
-            if (cube2(x, n)) {
-                int maxval = 0, minval = 0;
-                int j;
-                for (j = 0; j < nsquares; j++) {
-                    int m;
-                    int y = cages->blocks[b][j];
-                    if (i == j)
-                        continue;
-                    for (m = 1; m <= cr; m++)
-                        if (cube2(y, m)) {
-                            minval += m;
-                            break;
-                        }
-                    for (m = cr; m > 0; m--)
-                        if (cube2(y, m)) {
-                            maxval += m;
-                            break;
-                        }
-                }
+            if (cand2(x, n)) {
                 if (maxval + n < clues[b]) {
-                    cube2(x, n) = false;
+                    solver_rule_out(usage, x, n);
                     ret = 1;
 #ifdef STANDALONE_SOLVER
                     if (solver_show_working)
@@ -1467,7 +1682,7 @@ static int solver_killer_minmax(struct solver_usage *usage,
 #endif
                 }
                 if (minval + n > clues[b]) {
-                    cube2(x, n) = false;
+                    solver_rule_out(usage, x, n);
                     ret = 1;
 #ifdef STANDALONE_SOLVER
                     if (solver_show_working)
@@ -1571,12 +1786,9 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
             break;
 
         for (j = 0; j < nsquares; j++) {
-            int n;
-            unsigned long square_bits = bits;
             int x = cages->blocks[b][j];
-            for (n = 1; n <= cr; n++)
-                if (!cube2(x, n))
-                    square_bits &= ~(1L << n);
+            /* sum_bits[] keep digit n in bit n, not bit n-1 */
+            unsigned long square_bits = bits & (usage->cand[x] << 1);
             if (square_bits == 0) {
                 break;
             }
@@ -1597,10 +1809,10 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
         int n;
         int x = cages->blocks[b][i];
         for (n = 1; n <= cr; n++) {
-            if (!cube2(x, n))
+            if (!cand2(x, n))
                 continue;
             if ((possible_addends & (1 << n)) == 0) {
-                cube2(x, n) = false;
+                solver_rule_out(usage, x, n);
                 ret = 1;
 #ifdef STANDALONE_SOLVER
                 if (solver_show_working) {
@@ -1678,17 +1890,22 @@ static struct solver_scratch *solver_new_scratch(struct solver_usage *usage)
 {
     struct solver_scratch *scratch = snew(struct solver_scratch);
     int cr = usage->cr;
+    int i;
     scratch->grid = snewn(cr*cr, unsigned char);
     scratch->rowidx = snewn(cr, unsigned char);
     scratch->colidx = snewn(cr, unsigned char);
-    scratch->set = snewn(cr, unsigned char);
+    scratch->setrows = snewn(cr, candmask);
     scratch->neighbours = snewn(5*cr, int);
     scratch->bfsqueue = snewn(cr*cr, int);
 #ifdef STANDALONE_SOLVER
     scratch->bfsprev = snewn(cr*cr, int);
 #endif
-    scratch->indexlist = snewn(cr*cr, int);   /* used for set elimination */
-    scratch->indexlist2 = snewn(cr, int);   /* only used for intersect() */
+    /* position of each square along the line being intersected */
+    scratch->linepos = snewn(cr*cr, int);
+    for (i = 0; i < cr*cr; i++)
+        scratch->linepos[i] = -1;
+    scratch->cagesave = NULL;
+    scratch->cluesave = NULL;
     return scratch;
 }
 
@@ -1699,15 +1916,50 @@ static void solver_free_scratch(struct solver_scratch *scratch)
 #endif
     sfree(scratch->bfsqueue);
     sfree(scratch->neighbours);
-    sfree(scratch->set);
+    sfree(scratch->setrows);
     sfree(scratch->colidx);
     sfree(scratch->rowidx);
     sfree(scratch->grid);
-    sfree(scratch->indexlist);
-    sfree(scratch->indexlist2);
+    sfree(scratch->linepos);
+    sfree(scratch->cagesave);
+    sfree(scratch->cluesave);
     sfree(scratch);
 }
 
+/*
+ * Mark or unmark the squares of a line (a row, column or diagonal)
+ * with their positions along it, ready for solver_overlap().
+ */
+static void solver_mark_line(struct solver_usage *usage,
+                             struct solver_scratch *scratch,
+                             const int *cells, bool mark)
+{
+    int i;
+
+    for (i = 0; i < usage->cr; i++)
+        scratch->linepos[cells[i]] = mark ? i : -1;
+}
+
+/*
+ * Find where the currently marked line meets block b, as a set of
+ * positions along each of them.
+ */
+static void solver_overlap(struct solver_usage *usage,
+                           struct solver_scratch *scratch, int b,
+                           candmask *lineover, candmask *blkover)
+{
+    int i;
+
+    *lineover = *blkover = 0;
+    for (i = 0; i < usage->cr; i++) {
+        int p = scratch->linepos[usage->blocks->blocks[b][i]];
+        if (p >= 0) {
+            *lineover |= MASKBIT(p);
+            *blkover |= MASKBIT(i);
+        }
+    }
+}
+
 /*
  * Used for passing information about difficulty levels between the solver
  * and its callers.
@@ -1719,132 +1971,40 @@ struct difficulty {
     int diff, kdiff;
 };
 
-static void solver(int cr, struct block_structure *blocks,
-                  struct block_structure *kblocks, bool xtype,
-                  digit *grid, digit *kgrid, struct difficulty *dlev)
+/*
+ * Loop over the grid repeatedly trying all permitted modes of
+ * reasoning, until we complete an iteration without making any
+ * progress. Returns the hardest mode we needed, or DIFF_IMPOSSIBLE
+ * if we reached a contradiction; the killer difficulty is returned
+ * through *kdiffp.
+ */
+static int solver_deduce(struct solver_usage *usage,
+                         struct solver_scratch *scratch,
+                         struct difficulty *dlev, int *kdiffp)
 {
-    struct solver_usage *usage;
-    struct solver_scratch *scratch;
+    int cr = usage->cr;
     int x, y, b, i, n, ret;
     int diff = DIFF_BLOCK;
     int kdiff = DIFF_KSINGLE;
 
-    /*
-     * Set up a usage structure as a clean slate (everything
-     * possible).
-     */
-    usage = snew(struct solver_usage);
-    usage->cr = cr;
-    usage->blocks = blocks;
-    if (kblocks) {
-        usage->kblocks = dup_block_structure(kblocks);
-        usage->extra_cages = alloc_block_structure (kblocks->c, kblocks->r,
-                                                    cr * cr, cr, cr * cr);
-        usage->extra_clues = snewn(cr*cr, digit);
-    } else {
-        usage->kblocks = usage->extra_cages = NULL;
-        usage->extra_clues = NULL;
-    }
-    usage->cube = snewn(cr*cr*cr, bool);
-    usage->grid = grid;                       /* write straight back to the input */
-    if (kgrid) {
-        int nclues;
+    while (1) {
+        /*
+         * I'd like to write `continue;' inside each of the
+         * following loops, so that the solver returns here after
+         * making some progress. However, I can't specify that I
+         * want to continue an outer loop rather than the innermost
+         * one, so I'm apologetically resorting to a goto.
+         */
+        cont:
 
-        assert(kblocks);
-        nclues = kblocks->nr_blocks;
         /*
-         * Allow for expansion of the killer regions, the absolute
-         * limit is obviously one region per square.
-         */
-        usage->kclues = snewn(cr*cr, digit);
-        for (i = 0; i < nclues; i++) {
-            for (n = 0; n < kblocks->nr_squares[i]; n++)
-                if (kgrid[kblocks->blocks[i][n]] != 0)
-                    usage->kclues[i] = kgrid[kblocks->blocks[i][n]];
-            assert(usage->kclues[i] > 0);
-        }
-        memset(usage->kclues + nclues, 0, cr*cr - nclues);
-    } else {
-        usage->kclues = NULL;
-    }
-
-    for (i = 0; i < cr*cr*cr; i++)
-        usage->cube[i] = true;
-
-    usage->row = snewn(cr * cr, bool);
-    usage->col = snewn(cr * cr, bool);
-    usage->blk = snewn(cr * cr, bool);
-    memset(usage->row, 0, cr * cr * sizeof(bool));
-    memset(usage->col, 0, cr * cr * sizeof(bool));
-    memset(usage->blk, 0, cr * cr * sizeof(bool));
-
-    if (xtype) {
-        usage->diag = snewn(cr * 2, bool);
-        memset(usage->diag, 0, cr * 2 * sizeof(bool));
-    } else
-        usage->diag = NULL; 
-
-    usage->nr_regions = cr * 3 + (xtype ? 2 : 0);
-    usage->regions = snewn(cr * usage->nr_regions, int);
-    usage->sq2region = snewn(cr * cr * 3, int *);
-
-    for (n = 0; n < cr; n++) {
-        for (i = 0; i < cr; i++) {
-            x = n*cr+i;
-            y = i*cr+n;
-            b = usage->blocks->blocks[n][i];
-            usage->regions[cr*n*3 + i] = x;
-            usage->regions[cr*n*3 + cr + i] = y;
-            usage->regions[cr*n*3 + 2*cr + i] = b;
-            usage->sq2region[x*3] = usage->regions + cr*n*3;
-            usage->sq2region[y*3 + 1] = usage->regions + cr*n*3 + cr;
-            usage->sq2region[b*3 + 2] = usage->regions + cr*n*3 + 2*cr;
-        }
-    }
-
-    scratch = solver_new_scratch(usage);
-
-    /*
-     * Place all the clue numbers we are given.
-     */
-    for (x = 0; x < cr; x++)
-        for (y = 0; y < cr; y++) {
-            int n = grid[y*cr+x];
-            if (n) {
-                if (!cube(x,y,n)) {
-                    diff = DIFF_IMPOSSIBLE;
-                    goto got_result;
-                }
-                solver_place(usage, x, y, grid[y*cr+x]);
-            }
-        }
-
-    /*
-     * Now loop over the grid repeatedly trying all permitted modes
-     * of reasoning. The loop terminates if we complete an
-     * iteration without making any progress; we then return
-     * failure or success depending on whether the grid is full or
-     * not.
-     */
-    while (1) {
-        /*
-         * I'd like to write `continue;' inside each of the
-         * following loops, so that the solver returns here after
-         * making some progress. However, I can't specify that I
-         * want to continue an outer loop rather than the innermost
-         * one, so I'm apologetically resorting to a goto.
-         */
-        cont:
-
-        /*
-         * Blockwise positional elimination.
+         * Blockwise positional elimination.
          */
         for (b = 0; b < cr; b++)
             for (n = 1; n <= cr; n++)
                 if (!usage->blk[b*cr+n-1]) {
-                    for (i = 0; i < cr; i++)
-                        scratch->indexlist[i] = cubepos2(usage->blocks->blocks[b][i],n);
-                    ret = solver_elim(usage, scratch->indexlist
+                    ret = solver_elim(usage, usage->blkpos[b*cr+n-1],
+                                      usage->blocks->blocks[b], 0, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in block %s", n,
@@ -1887,7 +2047,7 @@ static void solver(int cr, struct block_structure *blocks,
                      * about the other squares in the cage.
                      */
                     for (n = 0; n < usage->kblocks->nr_squares[b]; n++) {
-                        cube2(usage->kblocks->blocks[b][n], t) = false;
+                        solver_rule_out(usage, usage->kblocks->blocks[b][n], t);
                     }
                 }
 
@@ -1905,7 +2065,7 @@ static void solver(int cr, struct block_structure *blocks,
                     }
                     x = usage->kblocks->blocks[b][0] % cr;
                     y = usage->kblocks->blocks[b][0] / cr;
-                    if (!cube(x, y, v)) {
+                    if (!cand(x, y, v)) {
                         diff = DIFF_IMPOSSIBLE;
                         goto got_result;
                     }
@@ -1955,7 +2115,7 @@ static void solver(int cr, struct block_structure *blocks,
                         continue;
                     if (dlev->maxdiff >= DIFF_RECURSIVE) {
                         if (sum <= 0) {
-                            dlev->diff = DIFF_IMPOSSIBLE;
+                            diff = DIFF_IMPOSSIBLE;
                             goto got_result;
                         }
                     }
@@ -1968,7 +2128,7 @@ static void solver(int cr, struct block_structure *blocks,
                         }
                         x = extra_list[0] % cr;
                         y = extra_list[0] / cr;
-                        if (!cube(x, y, sum)) {
+                        if (!cand(x, y, sum)) {
                             diff = DIFF_IMPOSSIBLE;
                             goto got_result;
                         }
@@ -2103,9 +2263,8 @@ static void solver(int cr, struct block_structure *blocks,
         for (y = 0; y < cr; y++)
             for (n = 1; n <= cr; n++)
                 if (!usage->row[y*cr+n-1]) {
-                    for (x = 0; x < cr; x++)
-                        scratch->indexlist[x] = cubepos(x, y, n);
-                    ret = solver_elim(usage, scratch->indexlist
+                    ret = solver_elim(usage, usage->rowpos[y*cr+n-1],
+                                      rowcells(y), 0, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in row %d", n, 1+y
@@ -2125,9 +2284,8 @@ static void solver(int cr, struct block_structure *blocks,
         for (x = 0; x < cr; x++)
             for (n = 1; n <= cr; n++)
                 if (!usage->col[x*cr+n-1]) {
-                    for (y = 0; y < cr; y++)
-                        scratch->indexlist[y] = cubepos(x, y, n);
-                    ret = solver_elim(usage, scratch->indexlist
+                    ret = solver_elim(usage, usage->colpos[x*cr+n-1],
+                                      colcells(x), 0, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in column %d", n, 1+x
@@ -2148,9 +2306,8 @@ static void solver(int cr, struct block_structure *blocks,
         if (usage->diag) {
             for (n = 1; n <= cr; n++)
                 if (!usage->diag[n-1]) {
-                    for (i = 0; i < cr; i++)
-                        scratch->indexlist[i] = cubepos2(diag0(i), n);
-                    ret = solver_elim(usage, scratch->indexlist
+                    ret = solver_elim(usage, usage->diagpos[n-1],
+                                      diagcells(0), 0, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in \\-diagonal", n
@@ -2166,9 +2323,8 @@ static void solver(int cr, struct block_structure *blocks,
                 }
             for (n = 1; n <= cr; n++)
                 if (!usage->diag[cr+n-1]) {
-                    for (i = 0; i < cr; i++)
-                        scratch->indexlist[i] = cubepos2(diag1(i), n);
-                    ret = solver_elim(usage, scratch->indexlist
+                    ret = solver_elim(usage, usage->diagpos[cr+n-1],
+                                      diagcells(1), 0, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in /-diagonal", n
@@ -2190,9 +2346,8 @@ static void solver(int cr, struct block_structure *blocks,
         for (x = 0; x < cr; x++)
             for (y = 0; y < cr; y++)
                 if (!usage->grid[y*cr+x]) {
-                    for (n = 1; n <= cr; n++)
-                        scratch->indexlist[n-1] = cubepos(x, y, n);
-                    ret = solver_elim(usage, scratch->indexlist
+                    ret = solver_elim(usage, usage->cand[y*cr+x],
+                                      NULL, y*cr+x, 0
 #ifdef STANDALONE_SOLVER
                                       , "numeric elimination at (%d,%d)",
                                       1+x, 1+y
@@ -2213,140 +2368,142 @@ static void solver(int cr, struct block_structure *blocks,
         /*
          * Intersectional analysis, rows vs blocks.
          */
-        for (y = 0; y < cr; y++)
-            for (b = 0; b < cr; b++)
+        for (y = 0; y < cr; y++) {
+            solver_mark_line(usage, scratch, rowcells(y), true);
+            for (b = 0; b < cr; b++) {
+                candmask lo, bo;
+
+                solver_overlap(usage, scratch, b, &lo, &bo);
+                if (!lo)
+                    continue;
                 for (n = 1; n <= cr; n++) {
                     if (usage->row[y*cr+n-1] ||
                         usage->blk[b*cr+n-1])
                         continue;
-                    for (i = 0; i < cr; i++) {
-                        scratch->indexlist[i] = cubepos(i, y, n);
-                        scratch->indexlist2[i] = cubepos2(usage->blocks->blocks[b][i], n);
-                    }
                     /*
                      * solver_intersect() never returns -1.
                      */
-                    if (solver_intersect(usage, scratch->indexlist,
-                                         scratch->indexlist2
+                    if (solver_intersect(usage, n,
+                                         usage->rowpos[y*cr+n-1], lo,
+                                         usage->blkpos[b*cr+n-1], bo,
+                                         usage->blocks->blocks[b]
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in row %d vs block %s",
                                           n, 1+y, usage->blocks->blocknames[b]
 #endif
                                           ) ||
-                         solver_intersect(usage, scratch->indexlist2,
-                                         scratch->indexlist
+                         solver_intersect(usage, n,
+                                          usage->blkpos[b*cr+n-1], bo,
+                                          usage->rowpos[y*cr+n-1], lo,
+                                          rowcells(y)
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in block %s vs row %d",
                                           n, usage->blocks->blocknames[b], 1+y
 #endif
                                           )) {
+                        solver_mark_line(usage, scratch, rowcells(y), false);
                         diff = max(diff, DIFF_INTERSECT);
                         goto cont;
                     }
                 }
+            }
+            solver_mark_line(usage, scratch, rowcells(y), false);
+        }
 
         /*
          * Intersectional analysis, columns vs blocks.
          */
-        for (x = 0; x < cr; x++)
-            for (b = 0; b < cr; b++)
+        for (x = 0; x < cr; x++) {
+            solver_mark_line(usage, scratch, colcells(x), true);
+            for (b = 0; b < cr; b++) {
+                candmask lo, bo;
+
+                solver_overlap(usage, scratch, b, &lo, &bo);
+                if (!lo)
+                    continue;
                 for (n = 1; n <= cr; n++) {
                     if (usage->col[x*cr+n-1] ||
                         usage->blk[b*cr+n-1])
                         continue;
-                    for (i = 0; i < cr; i++) {
-                        scratch->indexlist[i] = cubepos(x, i, n);
-                        scratch->indexlist2[i] = cubepos2(usage->blocks->blocks[b][i], n);
-                    }
-                    if (solver_intersect(usage, scratch->indexlist,
-                                         scratch->indexlist2
+                    if (solver_intersect(usage, n,
+                                         usage->colpos[x*cr+n-1], lo,
+                                         usage->blkpos[b*cr+n-1], bo,
+                                         usage->blocks->blocks[b]
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in column %d vs block %s",
                                           n, 1+x, usage->blocks->blocknames[b]
 #endif
                                           ) ||
-                         solver_intersect(usage, scratch->indexlist2,
-                                         scratch->indexlist
+                         solver_intersect(usage, n,
+                                          usage->blkpos[b*cr+n-1], bo,
+                                          usage->colpos[x*cr+n-1], lo,
+                                          colcells(x)
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in block %s vs column %d",
                                           n, usage->blocks->blocknames[b], 1+x
 #endif
                                           )) {
+                        solver_mark_line(usage, scratch, colcells(x), false);
                         diff = max(diff, DIFF_INTERSECT);
                         goto cont;
                     }
                 }
+            }
+            solver_mark_line(usage, scratch, colcells(x), false);
+        }
 
         if (usage->diag) {
             /*
-             * Intersectional analysis, \-diagonal vs blocks.
+             * Intersectional analysis, \-diagonal vs blocks, then
+             * /-diagonal vs blocks.
              */
-            for (b = 0; b < cr; b++)
-                for (n = 1; n <= cr; n++) {
-                    if (usage->diag[n-1] ||
-                        usage->blk[b*cr+n-1])
-                        continue;
-                    for (i = 0; i < cr; i++) {
-                        scratch->indexlist[i] = cubepos2(diag0(i), n);
-                        scratch->indexlist2[i] = cubepos2(usage->blocks->blocks[b][i], n);
-                    }
-                    if (solver_intersect(usage, scratch->indexlist,
-                                         scratch->indexlist2
-#ifdef STANDALONE_SOLVER
-                                          , "intersectional analysis,"
-                                          " %d in \\-diagonal vs block %s",
-                                          n, usage->blocks->blocknames[b]
-#endif
-                                          ) ||
-                         solver_intersect(usage, scratch->indexlist2,
-                                         scratch->indexlist
-#ifdef STANDALONE_SOLVER
-                                          , "intersectional analysis,"
-                                          " %d in block %s vs \\-diagonal",
-                                          n, usage->blocks->blocknames[b]
-#endif
-                                          )) {
-                        diff = max(diff, DIFF_INTERSECT);
-                        goto cont;
-                    }
-                }
+            for (i = 0; i < 2; i++) {
+                solver_mark_line(usage, scratch, diagcells(i), true);
+                for (b = 0; b < cr; b++) {
+                    candmask lo, bo;
 
-            /*
-             * Intersectional analysis, /-diagonal vs blocks.
-             */
-            for (b = 0; b < cr; b++)
-                for (n = 1; n <= cr; n++) {
-                    if (usage->diag[cr+n-1] ||
-                        usage->blk[b*cr+n-1])
+                    solver_overlap(usage, scratch, b, &lo, &bo);
+                    if (!lo)
                         continue;
-                    for (i = 0; i < cr; i++) {
-                        scratch->indexlist[i] = cubepos2(diag1(i), n);
-                        scratch->indexlist2[i] = cubepos2(usage->blocks->blocks[b][i], n);
-                    }
-                    if (solver_intersect(usage, scratch->indexlist,
-                                         scratch->indexlist2
+                    for (n = 1; n <= cr; n++) {
+                        if (usage->diag[i*cr+n-1] ||
+                            usage->blk[b*cr+n-1])
+                            continue;
+                        if (solver_intersect(usage, n,
+                                             usage->diagpos[i*cr+n-1], lo,
+                                             usage->blkpos[b*cr+n-1], bo,
+                                             usage->blocks->blocks[b]
 #ifdef STANDALONE_SOLVER
-                                          , "intersectional analysis,"
-                                          " %d in /-diagonal vs block %s",
-                                          n, usage->blocks->blocknames[b]
+                                             , "intersectional analysis,"
+                                             " %d in %c-diagonal vs block %s",
+                                             n, i ? '/' : '\\',
+                                             usage->blocks->blocknames[b]
 #endif
-                                          ) ||
-                         solver_intersect(usage, scratch->indexlist2,
-                                         scratch->indexlist
+                                             ) ||
+                            solver_intersect(usage, n,
+                                             usage->blkpos[b*cr+n-1], bo,
+                                             usage->diagpos[i*cr+n-1], lo,
+                                             diagcells(i)
 #ifdef STANDALONE_SOLVER
-                                          , "intersectional analysis,"
-                                          " %d in block %s vs /-diagonal",
-                                          n, usage->blocks->blocknames[b]
+                                             , "intersectional analysis,"
+                                             " %d in block %s vs %c-diagonal",
+                                             n, usage->blocks->blocknames[b],
+                                             i ? '/' : '\\'
 #endif
-                                          )) {
-                        diff = max(diff, DIFF_INTERSECT);
-                        goto cont;
+                                             )) {
+                            solver_mark_line(usage, scratch, diagcells(i),
+                                             false);
+                            diff = max(diff, DIFF_INTERSECT);
+                            goto cont;
+                        }
                     }
                 }
+                solver_mark_line(usage, scratch, diagcells(i), false);
+            }
         }
 
         if (dlev->maxdiff <= DIFF_INTERSECT)
@@ -2356,10 +2513,7 @@ static void solver(int cr, struct block_structure *blocks,
          * Blockwise set elimination.
          */
         for (b = 0; b < cr; b++) {
-            for (i = 0; i < cr; i++)
-                for (n = 1; n <= cr; n++)
-                    scratch->indexlist[i*cr+n-1] = cubepos2(usage->blocks->blocks[b][i], n);
-            ret = solver_set(usage, scratch, scratch->indexlist
+            ret = solver_set(usage, scratch, usage->blocks->blocks[b], 0
 #ifdef STANDALONE_SOLVER
                              , "set elimination, block %s",
                              usage->blocks->blocknames[b]
@@ -2378,10 +2532,7 @@ static void solver(int cr, struct block_structure *blocks,
          * Row-wise set elimination.
          */
         for (y = 0; y < cr; y++) {
-            for (x = 0; x < cr; x++)
-                for (n = 1; n <= cr; n++)
-                    scratch->indexlist[x*cr+n-1] = cubepos(x, y, n);
-            ret = solver_set(usage, scratch, scratch->indexlist
+            ret = solver_set(usage, scratch, rowcells(y), 0
 #ifdef STANDALONE_SOLVER
                              , "set elimination, row %d", 1+y
 #endif
@@ -2399,10 +2550,7 @@ static void solver(int cr, struct block_structure *blocks,
          * Column-wise set elimination.
          */
         for (x = 0; x < cr; x++) {
-            for (y = 0; y < cr; y++)
-                for (n = 1; n <= cr; n++)
-                    scratch->indexlist[y*cr+n-1] = cubepos(x, y, n);
-            ret = solver_set(usage, scratch, scratch->indexlist
+            ret = solver_set(usage, scratch, colcells(x), 0
 #ifdef STANDALONE_SOLVER
                              , "set elimination, column %d", 1+x
 #endif
@@ -2420,10 +2568,7 @@ static void solver(int cr, struct block_structure *blocks,
             /*
              * \-diagonal set elimination.
              */
-            for (i = 0; i < cr; i++)
-                for (n = 1; n <= cr; n++)
-                    scratch->indexlist[i*cr+n-1] = cubepos2(diag0(i), n);
-            ret = solver_set(usage, scratch, scratch->indexlist
+            ret = solver_set(usage, scratch, diagcells(0), 0
 #ifdef STANDALONE_SOLVER
                              , "set elimination, \\-diagonal"
 #endif
@@ -2439,10 +2584,7 @@ static void solver(int cr, struct block_structure *blocks,
             /*
              * /-diagonal set elimination.
              */
-            for (i = 0; i < cr; i++)
-                for (n = 1; n <= cr; n++)
-                    scratch->indexlist[i*cr+n-1] = cubepos2(diag1(i), n);
-            ret = solver_set(usage, scratch, scratch->indexlist
+            ret = solver_set(usage, scratch, diagcells(1), 0
 #ifdef STANDALONE_SOLVER
                              , "set elimination, /-diagonal"
 #endif
@@ -2463,10 +2605,7 @@ static void solver(int cr, struct block_structure *blocks,
          * Row-vs-column set elimination on a single number.
          */
         for (n = 1; n <= cr; n++) {
-            for (y = 0; y < cr; y++)
-                for (x = 0; x < cr; x++)
-                    scratch->indexlist[y*cr+x] = cubepos(x, y, n);
-            ret = solver_set(usage, scratch, scratch->indexlist
+            ret = solver_set(usage, scratch, NULL, n
 #ifdef STANDALONE_SOLVER
                              , "positional set elimination, number %d", n
 #endif
@@ -2495,177 +2634,708 @@ static void solver(int cr, struct block_structure *blocks,
         break;
     }
 
-    /*
-     * Last chance: if we haven't fully solved the puzzle yet, try
-     * recursing based on guesses for a particular square. We pick
-     * one of the most constrained empty squares we can find, which
-     * has the effect of pruning the search tree as much as
-     * possible.
-     */
-    if (dlev->maxdiff >= DIFF_RECURSIVE) {
-        int best, bestcount;
+    got_result:
+    *kdiffp = kdiff;
+    return diff;
+}
 
-        best = -1;
-        bestcount = cr+1;
+/*
+ * Save and restore the killer cages, which the solver reshapes as it
+ * goes, around a guess. Unlike the candidates these are snapshotted
+ * whole, one slot per level of guessing.
+ */
+static void solver_save_cages(struct solver_usage *usage,
+                              struct solver_scratch *scratch, int depth)
+{
+    struct block_structure *kb = usage->kblocks;
+    int area = usage->cr * usage->cr;
+    int *p = scratch->cagesave + depth * scratch->cagesavesize;
+
+    *p++ = kb->nr_blocks;
+    memcpy(p, kb->whichblock, area * sizeof *p);
+    p += area;
+    memcpy(p, kb->nr_squares, kb->nr_blocks * sizeof *p);
+    p += area;
+    memcpy(p, kb->blocks_data, kb->nr_blocks * kb->max_nr_squares * sizeof *p);
+    memcpy(scratch->cluesave + depth * area, usage->kclues, area);
+}
 
-        for (y = 0; y < cr; y++)
-            for (x = 0; x < cr; x++)
-                if (!grid[y*cr+x]) {
-                    int count;
+static void solver_restore_cages(struct solver_usage *usage,
+                                 struct solver_scratch *scratch, int depth)
+{
+    struct block_structure *kb = usage->kblocks;
+    int area = usage->cr * usage->cr;
+    int *p = scratch->cagesave + depth * scratch->cagesavesize;
+
+    kb->nr_blocks = *p++;
+    memcpy(kb->whichblock, p, area * sizeof *p);
+    p += area;
+    memcpy(kb->nr_squares, p, kb->nr_blocks * sizeof *p);
+    p += area;
+    memcpy(kb->blocks_data, p, kb->nr_blocks * kb->max_nr_squares * sizeof *p);
+    memcpy(usage->kclues, scratch->cluesave + depth * area, area);
+}
 
-                    /*
-                     * An unfilled square. Count the number of
-                     * possible digits in it.
-                     */
-                    count = 0;
-                    for (n = 1; n <= cr; n++)
-                        if (cube(x,y,n))
-                            count++;
+/*
+ * Check a complete grid against the original killer cages. Deduction
+ * splits cages up and keeps the pieces across guesses, and each piece
+ * only knows its own remaining sum, so nothing else stops a digit
+ * being repeated between two pieces of one cage.
+ */
+static bool solver_cages_hold(struct solver_usage *usage)
+{
+    struct block_structure *kb = usage->orig_kblocks;
+    int b, i;
 
-                    /*
-                     * We should have found any impossibilities
-                     * already, so this can safely be an assert.
-                     */
-                    assert(count > 1);
+    for (b = 0; b < kb->nr_blocks; b++) {
+        candmask seen = 0;
+        int sum = 0, clue = 0;
 
-                    if (count < bestcount) {
-                        bestcount = count;
-                        best = y*cr+x;
-                    }
-                }
+        for (i = 0; i < kb->nr_squares[b]; i++) {
+            int xy = kb->blocks[b][i];
+            candmask bit = MASKBIT(usage->grid[xy]-1);
+
+            if (seen & bit)
+                return false;
+            seen |= bit;
+            sum += usage->grid[xy];
+            if (usage->kgrid[xy])
+                clue = usage->kgrid[xy];
+        }
+        if (sum != clue)
+            return false;
+    }
+    return true;
+}
 
-        if (best != -1) {
-            int i, j;
-            digit *list, *ingrid, *outgrid;
+/*
+ * Last chance: if deduction hasn't fully solved the puzzle, guess.
+ * We pick one of the currently most constrained empty squares, which
+ * has the effect of pruning the search tree as much as possible, and
+ * try each of its candidates in turn, deducing as far as we can from
+ * each guess and recursing. Everything a guess changes is rolled back
+ * off the trail afterwards, so the search does no allocation.
+ *
+ * Complete grids are counted in usage->nsolutions, and we give up as
+ * soon as we have found two.
+ */
+static void solver_search(struct solver_usage *usage,
+                          struct solver_scratch *scratch,
+                          struct difficulty *dlev, int depth)
+{
+    int cr = usage->cr;
+    int x, y, n, best, bestcount, kdiff;
+    candmask list;
 
-            diff = DIFF_IMPOSSIBLE;    /* no solution found yet */
+    best = -1;
+    bestcount = cr+1;
 
-            /*
-             * Attempt recursion.
-             */
-            y = best / cr;
-            x = best % cr;
+    for (y = 0; y < cr; y++)
+        for (x = 0; x < cr; x++)
+            if (!usage->grid[y*cr+x]) {
+                /*
+                 * An unfilled square. Count the number of possible
+                 * digits in it.
+                 */
+                int count = bitcount(usage->cand[y*cr+x]);
+
+                /*
+                 * We should have found any impossibilities
+                 * already, so this can safely be an assert.
+                 */
+                assert(count > 1);
+
+                if (count < bestcount) {
+                    bestcount = count;
+                    best = y*cr+x;
+                }
+            }
 
-            list = snewn(cr, digit);
-            ingrid = snewn(cr * cr, digit);
-            outgrid = snewn(cr * cr, digit);
-            memcpy(ingrid, grid, cr * cr);
+    if (best == -1) {
+        /*
+         * The grid is full. Deduction has already taken every
+         * filled square out of the killer cages, so each cage's
+         * remaining sum must have come out at exactly zero; and
+         * the original cages must still hold.
+         */
+        if (usage->kclues) {
+            int b;
+            for (b = 0; b < usage->kblocks->nr_blocks; b++)
+                if (usage->kclues[b])
+                    return;
+            if (!solver_cages_hold(usage))
+                return;
+        }
+        if (usage->nsolutions++ == 0)
+            memcpy(usage->solution, usage->grid, cr*cr);
+        return;
+    }
 
-            /* Make a list of the possible digits. */
-            for (j = 0, n = 1; n <= cr; n++)
-                if (cube(x,y,n))
-                    list[j++] = n;
+    y = best / cr;
+    x = best % cr;
+    list = usage->cand[best];
 
 #ifdef STANDALONE_SOLVER
-            if (solver_show_working) {
-                const char *sep = "";
-                printf("%*srecursing on (%d,%d) [",
-                       solver_recurse_depth*4, "", x + 1, y + 1);
-                for (i = 0; i < j; i++) {
-                    printf("%s%d", sep, list[i]);
-                    sep = " or ";
-                }
-                printf("]\n");
+    if (solver_show_working) {
+        const char *sep = "";
+        printf("%*srecursing on (%d,%d) [",
+               solver_recurse_depth*4, "", x + 1, y + 1);
+        for (n = 1; n <= cr; n++)
+            if (list & MASKBIT(n-1)) {
+                printf("%s%d", sep, n);
+                sep = " or ";
             }
+        printf("]\n");
+    }
 #endif
 
-            /*
-             * And step along the list, recursing back into the
-             * main solver at every stage.
-             */
-            for (i = 0; i < j; i++) {
-                memcpy(outgrid, ingrid, cr * cr);
-                outgrid[y*cr+x] = list[i];
+    for (n = 1; n <= cr; n++) {
+        int mark = usage->ntrail;
+
+        if (!(list & MASKBIT(n-1)))
+            continue;
+
+        if (usage->kclues)
+            solver_save_cages(usage, scratch, depth);
 
 #ifdef STANDALONE_SOLVER
-                if (solver_show_working)
-                    printf("%*sguessing %d at (%d,%d)\n",
-                           solver_recurse_depth*4, "", list[i], x + 1, y + 1);
-                solver_recurse_depth++;
+        if (solver_show_working)
+            printf("%*sguessing %d at (%d,%d)\n",
+                   solver_recurse_depth*4, "", n, x + 1, y + 1);
+        solver_recurse_depth++;
 #endif
 
-                solver(cr, blocks, kblocks, xtype, outgrid, kgrid, dlev);
+        solver_place(usage, x, y, n);
+        if (solver_deduce(usage, scratch, dlev, &kdiff) != DIFF_IMPOSSIBLE)
+            solver_search(usage, scratch, dlev, depth + 1);
+#ifdef STANDALONE_SOLVER
+        else if (solver_show_working)
+            printf("%*sno solution found\n", solver_recurse_depth*4, "");
+#endif
 
 #ifdef STANDALONE_SOLVER
-                solver_recurse_depth--;
-                if (solver_show_working) {
-                    printf("%*sretracting %d at (%d,%d)\n",
-                           solver_recurse_depth*4, "", list[i], x + 1, y + 1);
+        solver_recurse_depth--;
+        if (solver_show_working)
+            printf("%*sretracting %d at (%d,%d)\n",
+                   solver_recurse_depth*4, "", n, x + 1, y + 1);
+#endif
+
+        solver_undo(usage, mark);
+        if (usage->kclues)
+            solver_restore_cages(usage, scratch, depth);
+
+        /*
+         * As soon as we've found more than one solution, give up
+         * immediately.
+         */
+        if (usage->nsolutions > 1)
+            break;
+    }
+}
+
+static void solver(int cr, struct block_structure *blocks,
+                  struct block_structure *kblocks, bool xtype,
+                  digit *grid, digit *kgrid, struct difficulty *dlev)
+{
+    struct solver_usage *usage;
+    struct solver_scratch *scratch;
+    int x, y, b, i, n;
+    int diff = DIFF_BLOCK;
+    int kdiff = DIFF_KSINGLE;
+    candmask all = (MASKBIT(cr-1) << 1) - 1;
+
+    /*
+     * Set up a usage structure as a clean slate (everything
+     * possible).
+     */
+    usage = snew(struct solver_usage);
+    usage->cr = cr;
+    usage->blocks = blocks;
+    if (kblocks) {
+        /*
+         * Leave room for the cages to be split down as far as one
+         * per square, so that split_block() never has to reallocate.
+         */
+        usage->kblocks = dup_block_structure_room(kblocks, cr * cr);
+        usage->extra_cages = alloc_block_structure (kblocks->c, kblocks->r,
+                                                    cr * cr, cr, cr * cr);
+        usage->extra_cages->nr_blocks = 0;
+        usage->extra_clues = snewn(cr*cr, digit);
+    } else {
+        usage->kblocks = usage->extra_cages = NULL;
+        usage->extra_clues = NULL;
+    }
+    usage->cand = snewn(cr*cr, candmask);
+    usage->rowpos = snewn(cr*cr, candmask);
+    usage->colpos = snewn(cr*cr, candmask);
+    usage->blkpos = snewn(cr*cr, candmask);
+    usage->blkindex = snewn(cr*cr, int);
+    usage->grid = grid;                       /* write straight back to the input */
+    usage->ntrail = usage->nsolutions = 0;
+    if (dlev->maxdiff >= DIFF_RECURSIVE) {
+        /*
+         * Along any one line of the search each candidate is ruled
+         * out at most once and each square filled in at most once.
+         */
+        usage->trail = snewn(cr*cr*cr + cr*cr, int);
+        usage->solution = snewn(cr*cr, digit);
+    } else {
+        usage->trail = NULL;
+        usage->solution = NULL;
+    }
+    if (kgrid) {
+        int nclues;
+
+        assert(kblocks);
+        nclues = kblocks->nr_blocks;
+        /*
+         * Allow for expansion of the killer regions, the absolute
+         * limit is obviously one region per square.
+         */
+        usage->kclues = snewn(cr*cr, digit);
+        usage->orig_kblocks = kblocks;
+        usage->kgrid = kgrid;
+        for (i = 0; i < nclues; i++) {
+            for (n = 0; n < kblocks->nr_squares[i]; n++)
+                if (kgrid[kblocks->blocks[i][n]] != 0)
+                    usage->kclues[i] = kgrid[kblocks->blocks[i][n]];
+            assert(usage->kclues[i] > 0);
+        }
+        memset(usage->kclues + nclues, 0, cr*cr - nclues);
+    } else {
+        usage->kclues = NULL;
+        usage->orig_kblocks = NULL;
+        usage->kgrid = NULL;
+    }
+
+    for (i = 0; i < cr*cr; i++)
+        usage->cand[i] = usage->rowpos[i] = usage->colpos[i] =
+            usage->blkpos[i] = all;
+
+    usage->row = snewn(cr * cr, bool);
+    usage->col = snewn(cr * cr, bool);
+    usage->blk = snewn(cr * cr, bool);
+    memset(usage->row, 0, cr * cr * sizeof(bool));
+    memset(usage->col, 0, cr * cr * sizeof(bool));
+    memset(usage->blk, 0, cr * cr * sizeof(bool));
+
+    if (xtype) {
+        usage->diag = snewn(cr * 2, bool);
+        memset(usage->diag, 0, cr * 2 * sizeof(bool));
+        usage->diagpos = snewn(cr * 2, candmask);
+        for (i = 0; i < cr * 2; i++)
+            usage->diagpos[i] = all;
+    } else {
+        usage->diag = NULL; 
+        usage->diagpos = NULL;
+    }
+
+    usage->nr_regions = cr * 3 + (xtype ? 2 : 0);
+    usage->regions = snewn(cr * usage->nr_regions, int);
+    usage->sq2region = snewn(cr * cr * 3, int *);
+
+    for (n = 0; n < cr; n++) {
+        for (i = 0; i < cr; i++) {
+            x = n*cr+i;
+            y = i*cr+n;
+            b = usage->blocks->blocks[n][i];
+            usage->regions[cr*n*3 + i] = x;
+            usage->regions[cr*n*3 + cr + i] = y;
+            usage->regions[cr*n*3 + 2*cr + i] = b;
+            usage->sq2region[x*3] = usage->regions + cr*n*3;
+            usage->sq2region[y*3 + 1] = usage->regions + cr*n*3 + cr;
+            usage->sq2region[b*3 + 2] = usage->regions + cr*n*3 + 2*cr;
+            usage->blkindex[b] = i;
+        }
+        if (xtype) {
+            diagcells(0)[n] = diag0(n);
+            diagcells(1)[n] = diag1(n);
+        }
+    }
+
+    scratch = solver_new_scratch(usage);
+
+    /*
+     * Place all the clue numbers we are given.
+     */
+    for (x = 0; x < cr; x++)
+        for (y = 0; y < cr; y++) {
+            int n = grid[y*cr+x];
+            if (n) {
+                if (!cand(x,y,n)) {
+                    diff = DIFF_IMPOSSIBLE;
+                    goto got_result;
                 }
+                solver_place(usage, x, y, grid[y*cr+x]);
+            }
+        }
+
+    diff = solver_deduce(usage, scratch, dlev, &kdiff);
+    if (diff == DIFF_IMPOSSIBLE)
+        goto got_result;
+
+    if (dlev->maxdiff >= DIFF_RECURSIVE) {
+        int nempty = 0;
+
+        for (i = 0; i < cr*cr; i++)
+            if (!grid[i])
+                nempty++;
+
+        if (nempty) {
+            /*
+             * Each level of guessing fills in at least one square,
+             * which bounds the depth of the search.
+             */
+            if (usage->kclues) {
+                scratch->cagesavesize =
+                    1 + 2*cr*cr + cr*cr * usage->kblocks->max_nr_squares;
+                scratch->cagesave = snewn(nempty * scratch->cagesavesize, int);
+                scratch->cluesave = snewn(nempty * cr*cr, digit);
+            }
+
+            solver_search(usage, scratch, dlev, 0);
+
+            if (usage->nsolutions == 0)
+                diff = DIFF_IMPOSSIBLE;
+            else {
+                diff = (usage->nsolutions == 1 ? DIFF_RECURSIVE :
+                        DIFF_AMBIGUOUS);
+                memcpy(grid, usage->solution, cr*cr);
+            }
+        }
+    } else {
+        /*
+         * We're forbidden to use recursion, so we just see whether
+         * our grid is fully solved, and return DIFF_IMPOSSIBLE
+         * otherwise.
+         */
+        for (y = 0; y < cr; y++)
+            for (x = 0; x < cr; x++)
+                if (!grid[y*cr+x])
+                    diff = DIFF_IMPOSSIBLE;
+    }
+
+    got_result:
+    dlev->diff = diff;
+    dlev->kdiff = kdiff;
+
+#ifdef STANDALONE_SOLVER
+    if (solver_show_working)
+        printf("%*s%s found\n",
+               solver_recurse_depth*4, "",
+               diff == DIFF_IMPOSSIBLE ? "no solution" :
+               diff == DIFF_AMBIGUOUS ? "multiple solutions" :
+               "one solution");
 #endif
 
-                /*
-                 * If we have our first solution, copy it into the
-                 * grid we will return.
-                 */
-                if (diff == DIFF_IMPOSSIBLE && dlev->diff != DIFF_IMPOSSIBLE)
-                    memcpy(grid, outgrid, cr*cr);
-
-                if (dlev->diff == DIFF_AMBIGUOUS)
-                    diff = DIFF_AMBIGUOUS;
-                else if (dlev->diff == DIFF_IMPOSSIBLE)
-                    /* do not change our return value */;
-                else {
-                    /* the recursion turned up exactly one solution */
-                    if (diff == DIFF_IMPOSSIBLE)
-                        diff = DIFF_RECURSIVE;
-                    else
-                        diff = DIFF_AMBIGUOUS;
-                }
+    sfree(usage->sq2region);
+    sfree(usage->regions);
+    sfree(usage->cand);
+    sfree(usage->rowpos);
+    sfree(usage->colpos);
+    sfree(usage->blkpos);
+    sfree(usage->blkindex);
+    sfree(usage->trail);
+    sfree(usage->solution);
+    sfree(usage->diagpos);
+    sfree(usage->diag);
+    sfree(usage->row);
+    sfree(usage->col);
+    sfree(usage->blk);
+    if (usage->kblocks) {
+        free_block_structure(usage->kblocks);
+        free_block_structure(usage->extra_cages);
+        sfree(usage->extra_clues);
+    }
+    if (usage->kclues) sfree(usage->kclues);
+    sfree(usage);
+
+    solver_free_scratch(scratch);
+}
+
+/* ----------------------------------------------------------------------
+ * Exact-cover solution counter.
+ *
+ * A lot of the time the generator doesn't care how hard a grid is,
+ * only whether it has exactly one solution. The technique solver
+ * above is an expensive way to find that out, so for those questions
+ * we use Knuth's Dancing Links instead.
+ *
+ * Each (square, digit) pair is a row of the exact-cover matrix, and
+ * the columns say that every square is filled and that every row,
+ * column, block and (for X puzzles) diagonal contains every digit
+ * exactly once.
+ *
+ * A killer cage becomes a column of its own plus one column per
+ * digit. Each way of making the cage's sum from distinct digits is a
+ * row, covering the cage's column and the columns of all the digits
+ * it _doesn't_ use; a (square, digit) row in the cage covers that
+ * digit's column. So once the search picks a combination, each of
+ * its digits has to be placed exactly once in the cage and no other
+ * digit can be placed there at all.
+ *
+ * The matrix depends only on the block and cage structure, so it can
+ * be built once and then asked about any number of grids.
+ */
+
+struct dlx_node {
+    int left, right, up, down;
+    int col;                           /* header node of our column */
+};
+
+struct dlx {
+    int cr;
+    /*
+     * Node 0 is the root and nodes 1 to ncols are the column
+     * headers; the rows come after them. cellrow[xy*cr+n-1] is the
+     * first node of the row placing n in square xy.
+     */
+    struct dlx_node *nodes;
+    int nnodes, nodesize, ncols;
+    int *size;                         /* number of rows left in a column */
+    bool *covered;                     /* column is already used up */
+    int *cellrow;
+    int nsolutions;
+};
+
+static void dlx_add_row(struct dlx *dlx, const int *cols, int ncols)
+{
+    int base = dlx->nnodes, i;
+
+    if (dlx->nnodes + ncols > dlx->nodesize) {
+        dlx->nodesize = (dlx->nnodes + ncols) * 5 / 4 + 64;
+        dlx->nodes = sresize(dlx->nodes, dlx->nodesize, struct dlx_node);
+    }
+    for (i = 0; i < ncols; i++) {
+        struct dlx_node *p = &dlx->nodes[base + i];
+        struct dlx_node *h = &dlx->nodes[cols[i]];
+
+        p->left = base + (i + ncols - 1) % ncols;
+        p->right = base + (i + 1) % ncols;
+        p->col = cols[i];
+        p->up = h->up;
+        p->down = cols[i];
+        dlx->nodes[h->up].down = base + i;
+        h->up = base + i;
+        dlx->size[cols[i]]++;
+    }
+    dlx->nnodes += ncols;
+}
+
+static struct dlx *dlx_new(int cr, struct block_structure *blocks,
+                           struct block_structure *kblocks, bool xtype,
+                           digit *kgrid)
+{
+    struct dlx *dlx = snew(struct dlx);
+    int area = cr*cr;
+    int ncages = kblocks ? kblocks->nr_blocks : 0;
+    int diagcol = 1 + 4*area, cagecol = diagcol + (xtype ? 2*cr : 0);
+    int cols[8];
+    int c, i, k, xy, n;
+
+    dlx->cr = cr;
+    dlx->ncols = cagecol - 1 + ncages*(cr+1);
+    dlx->nnodes = 1 + dlx->ncols;
+    dlx->nodesize = dlx->nnodes + area*cr*(4 + (xtype ? 2 : 0) +
+                                           (kblocks ? 1 : 0));
+    dlx->nodes = snewn(dlx->nodesize, struct dlx_node);
+    dlx->size = snewn(dlx->ncols + 1, int);
+    dlx->covered = snewn(dlx->ncols + 1, bool);
+    dlx->cellrow = snewn(area*cr, int);
+
+    for (c = 0; c <= dlx->ncols; c++) {
+        struct dlx_node *h = &dlx->nodes[c];
+        h->up = h->down = h->col = c;
+        h->left = (c + dlx->ncols) % (dlx->ncols + 1);
+        h->right = (c + 1) % (dlx->ncols + 1);
+        dlx->size[c] = 0;
+        dlx->covered[c] = false;
+    }
+
+    for (xy = 0; xy < area; xy++) {
+        int x = xy % cr, y = xy / cr, b = blocks->whichblock[xy];
+
+        for (n = 0; n < cr; n++) {
+            int ncols = 0;
+
+            cols[ncols++] = 1 + xy;
+            cols[ncols++] = 1 + area + y*cr + n;
+            cols[ncols++] = 1 + 2*area + x*cr + n;
+            cols[ncols++] = 1 + 3*area + b*cr + n;
+            if (xtype && ondiag0(xy))
+                cols[ncols++] = diagcol + n;
+            if (xtype && ondiag1(xy))
+                cols[ncols++] = diagcol + cr + n;
+            if (kblocks)
+                cols[ncols++] = cagecol + kblocks->whichblock[xy]*(cr+1) + 1+n;
+
+            dlx->cellrow[xy*cr+n] = dlx->nnodes;
+            dlx_add_row(dlx, cols, ncols);
+        }
+    }
+
+    for (k = 0; k < ncages; k++) {
+        int sum = 0, nsq = kblocks->nr_squares[k];
+        int *ccols = snewn(cr+1, int);
+        unsigned mask;
+
+        if (kgrid)
+            for (i = 0; i < nsq; i++)
+                if (kgrid[kblocks->blocks[k][i]])
+                    sum = kgrid[kblocks->blocks[k][i]];
+
+        for (mask = 0; mask < (1U << cr); mask++) {
+            int ncols = 0, msum = 0;
+
+            if (bitcount(mask) != nsq)
+                continue;
+            for (n = 0; n < cr; n++)
+                if (mask & (1U << n))
+                    msum += n+1;
+            if (sum && msum != sum)
+                continue;
+
+            ccols[ncols++] = cagecol + k*(cr+1);
+            for (n = 0; n < cr; n++)
+                if (!(mask & (1U << n)))
+                    ccols[ncols++] = cagecol + k*(cr+1) + 1+n;
+            dlx_add_row(dlx, ccols, ncols);
+        }
+        sfree(ccols);
+    }
+
+    return dlx;
+}
+
+static void dlx_free(struct dlx *dlx)
+{
+    sfree(dlx->nodes);
+    sfree(dlx->size);
+    sfree(dlx->covered);
+    sfree(dlx->cellrow);
+    sfree(dlx);
+}
+
+static void dlx_cover(struct dlx *dlx, int c)
+{
+    struct dlx_node *nodes = dlx->nodes;
+    int i, j;
 
-                /*
-                 * As soon as we've found more than one solution,
-                 * give up immediately.
-                 */
-                if (diff == DIFF_AMBIGUOUS)
-                    break;
-            }
+    nodes[nodes[c].right].left = nodes[c].left;
+    nodes[nodes[c].left].right = nodes[c].right;
+    for (i = nodes[c].down; i != c; i = nodes[i].down)
+        for (j = nodes[i].right; j != i; j = nodes[j].right) {
+            nodes[nodes[j].down].up = nodes[j].up;
+            nodes[nodes[j].up].down = nodes[j].down;
+            dlx->size[nodes[j].col]--;
+        }
+    dlx->covered[c] = true;
+}
+
+static void dlx_uncover(struct dlx *dlx, int c)
+{
+    struct dlx_node *nodes = dlx->nodes;
+    int i, j;
 
-            sfree(outgrid);
-            sfree(ingrid);
-            sfree(list);
+    dlx->covered[c] = false;
+    for (i = nodes[c].up; i != c; i = nodes[i].up)
+        for (j = nodes[i].left; j != i; j = nodes[j].left) {
+            dlx->size[nodes[j].col]++;
+            nodes[nodes[j].down].up = j;
+            nodes[nodes[j].up].down = j;
         }
+    nodes[nodes[c].right].left = c;
+    nodes[nodes[c].left].right = c;
+}
 
-    } else {
-        /*
-         * We're forbidden to use recursion, so we just see whether
-         * our grid is fully solved, and return DIFF_IMPOSSIBLE
-         * otherwise.
-         */
-        for (y = 0; y < cr; y++)
-            for (x = 0; x < cr; x++)
-                if (!grid[y*cr+x])
-                    diff = DIFF_IMPOSSIBLE;
+static void dlx_search(struct dlx *dlx)
+{
+    struct dlx_node *nodes = dlx->nodes;
+    int c, i, j, best;
+
+    if (nodes[0].right == 0) {
+        dlx->nsolutions++;
+        return;
     }
 
-    got_result:
-    dlev->diff = diff;
-    dlev->kdiff = kdiff;
+    /*
+     * Branch on the column with the fewest rows left.
+     */
+    best = nodes[0].right;
+    for (c = nodes[best].right; c != 0 && dlx->size[best] > 1;
+         c = nodes[c].right)
+        if (dlx->size[c] < dlx->size[best])
+            best = c;
+    if (dlx->size[best] == 0)
+        return;
+
+    dlx_cover(dlx, best);
+    for (i = nodes[best].down; i != best; i = nodes[i].down) {
+        for (j = nodes[i].right; j != i; j = nodes[j].right)
+            dlx_cover(dlx, nodes[j].col);
+        dlx_search(dlx);
+        for (j = nodes[i].left; j != i; j = nodes[j].left)
+            dlx_uncover(dlx, nodes[j].col);
+
+        if (dlx->nsolutions > 1)
+            break;
+    }
+    dlx_uncover(dlx, best);
+}
 
-#ifdef STANDALONE_SOLVER
-    if (solver_show_working)
-        printf("%*s%s found\n",
-               solver_recurse_depth*4, "",
-               diff == DIFF_IMPOSSIBLE ? "no solution" :
-               diff == DIFF_AMBIGUOUS ? "multiple solutions" :
-               "one solution");
-#endif
+/*
+ * Count the solutions of a grid (0 for empty squares), stopping at
+ * two. The matrix is left as it was found.
+ */
+static int dlx_count(struct dlx *dlx, const digit *grid)
+{
+    struct dlx_node *nodes = dlx->nodes;
+    int cr = dlx->cr, area = cr*cr;
+    int xy, i, j, placed;
+    bool ok = true;
 
-    sfree(usage->sq2region);
-    sfree(usage->regions);
-    sfree(usage->cube);
-    sfree(usage->row);
-    sfree(usage->col);
-    sfree(usage->blk);
-    if (usage->kblocks) {
-        free_block_structure(usage->kblocks);
-        free_block_structure(usage->extra_cages);
-        sfree(usage->extra_clues);
+    /*
+     * Select the rows for the clues, stopping if one of them needs
+     * a column that an earlier clue has already used up.
+     */
+    for (xy = placed = 0; xy < area && ok; xy++) {
+        if (!grid[xy])
+            continue;
+        i = dlx->cellrow[xy*cr + grid[xy]-1];
+        j = i;
+        do {
+            if (dlx->covered[nodes[j].col])
+                ok = false;
+            j = nodes[j].right;
+        } while (j != i);
+        if (!ok)
+            break;
+        do {
+            dlx_cover(dlx, nodes[j].col);
+            j = nodes[j].right;
+        } while (j != i);
+        placed = xy + 1;
     }
-    if (usage->kclues) sfree(usage->kclues);
-    sfree(usage);
 
-    solver_free_scratch(scratch);
+    dlx->nsolutions = 0;
+    if (ok)
+        dlx_search(dlx);
+
+    /*
+     * Put everything back, in the reverse order.
+     */
+    for (xy = placed; xy-- > 0 ;) {
+        if (!grid[xy])
+            continue;
+        i = dlx->cellrow[xy*cr + grid[xy]-1];
+        j = i;
+        do {
+            j = nodes[j].left;
+            dlx_uncover(dlx, nodes[j].col);
+        } while (j != i);
+    }
+
+    return dlx->nsolutions;
 }
 
 /* ----------------------------------------------------------------------
@@ -2699,10 +3369,12 @@ static void solver(int cr, struct block_structure *blocks,
  * idea is that filling in lots of the obvious bits (particularly
  * any squares with only one possibility) will cut down on the list
  * of possibilities for other squares and hence reduce the enormous
- * search space as much as possible as early as possible.
+ * search space as much as possible as early as possible. It also
+ * watches for digits with only one square left to go in, which on
+ * the big grids matter as much as squares with one digit left.
  *
- * The use of bit sets implies that we support puzzles up to a size of
- * 32x32 (less if anyone finds a 16-bit machine to compile this on).
+ * The used-digit sets are as many 64-bit words wide as the puzzle
+ * needs, so any order up to ORDER_MAX can be filled.
  */
 
 /*
@@ -2716,58 +3388,161 @@ struct gridgen_usage {
     /* grid is a copy of the input grid, modified as we go along */
     digit *grid;
     /*
-     * Bitsets.  In each of them, bit n is set if digit n has been placed
-     * in the corresponding region.  row, col and blk are used for all
-     * puzzles.  cge is used only for killer puzzles, and diag is used
-     * only for x-type puzzles.
-     * All of these have cr entries, except diag which only has 2,
-     * and cge, which has as many entries as kblocks.
+     * Bitsets, each nwords candmasks long so that we aren't limited
+     * to the digits that fit in one machine word. In each of them,
+     * bit n-1 is set if digit n has been placed in the corresponding
+     * region. row, col and blk are used for all puzzles. cge is used
+     * only for killer puzzles, and diag is used only for x-type
+     * puzzles.
+     * All of these have cr sets, except diag which only has 2,
+     * and cge, which has as many sets as kblocks.
+     */
+    int nwords;
+    candmask *row, *col, *blk, *cge, *diag;
+    /* The digits still possible in each space, nwords per space. */
+    candmask *avail;
+    /*
+     * Scratch sets, for each row, column, block and diagonal, of the
+     * digits which could still go in at least one of its spaces and
+     * in at least two.
      */
-    unsigned int *row, *col, *blk, *cge, *diag;
+    candmask *once, *twice;
     /* This lists all the empty spaces remaining in the grid. */
     struct gridgen_coord *spaces;
-    int nspaces;
+    int nspaces, maxspaces;
+    /*
+     * The choices being tried at each depth of the search, as
+     * square*cr + digit-1; depth d uses choices[d*cr] onwards.
+     */
+    int *choices;
     /* If we need randomisation in the solve, this is our random state. */
     random_state *rs;
 };
 
+#define GGWORD(n) (((n)-1) / 64)
+#define GGBIT(n) MASKBIT(((n)-1) % 64)
+
 static void gridgen_place(struct gridgen_usage *usage, int x, int y, digit n)
 {
-    unsigned int bit = 1 << n;
-    int cr = usage->cr;
-    usage->row[y] |= bit;
-    usage->col[x] |= bit;
-    usage->blk[usage->blocks->whichblock[y*cr+x]] |= bit;
+    candmask bit = GGBIT(n);
+    int cr = usage->cr, nw = usage->nwords, w = GGWORD(n);
+    usage->row[y*nw+w] |= bit;
+    usage->col[x*nw+w] |= bit;
+    usage->blk[usage->blocks->whichblock[y*cr+x]*nw+w] |= bit;
     if (usage->cge)
-        usage->cge[usage->kblocks->whichblock[y*cr+x]] |= bit;
+        usage->cge[usage->kblocks->whichblock[y*cr+x]*nw+w] |= bit;
     if (usage->diag) {
         if (ondiag0(y*cr+x))
-            usage->diag[0] |= bit;
+            usage->diag[w] |= bit;
         if (ondiag1(y*cr+x))
-            usage->diag[1] |= bit;
+            usage->diag[nw+w] |= bit;
     }
     usage->grid[y*cr+x] = n;
 }
 
 static void gridgen_remove(struct gridgen_usage *usage, int x, int y, digit n)
 {
-    unsigned int mask = ~(1 << n);
-    int cr = usage->cr;
-    usage->row[y] &= mask;
-    usage->col[x] &= mask;
-    usage->blk[usage->blocks->whichblock[y*cr+x]] &= mask;
+    candmask mask = ~GGBIT(n);
+    int cr = usage->cr, nw = usage->nwords, w = GGWORD(n);
+    usage->row[y*nw+w] &= mask;
+    usage->col[x*nw+w] &= mask;
+    usage->blk[usage->blocks->whichblock[y*cr+x]*nw+w] &= mask;
     if (usage->cge)
-        usage->cge[usage->kblocks->whichblock[y*cr+x]] &= mask;
+        usage->cge[usage->kblocks->whichblock[y*cr+x]*nw+w] &= mask;
     if (usage->diag) {
         if (ondiag0(y*cr+x))
-            usage->diag[0] &= mask;
+            usage->diag[w] &= mask;
         if (ondiag1(y*cr+x))
-            usage->diag[1] &= mask;
+            usage->diag[nw+w] &= mask;
     }
     usage->grid[y*cr+x] = 0;
 }
 
-#define N_SINGLE 32
+/*
+ * The regions we look for hidden singles in are numbered with the
+ * rows first, then the columns, the blocks, and (in X mode) the two
+ * diagonals. This lists the ones a square is in, returning how many
+ * there are.
+ */
+static int gridgen_regions(struct gridgen_usage *usage, int x, int y,
+                           int *region)
+{
+    int cr = usage->cr, nr = 0;
+
+    region[nr++] = y;
+    region[nr++] = cr + x;
+    region[nr++] = 2*cr + usage->blocks->whichblock[y*cr+x];
+    if (usage->diag && ondiag0(y*cr+x))
+        region[nr++] = 3*cr;
+    if (usage->diag && ondiag1(y*cr+x))
+        region[nr++] = 3*cr+1;
+    return nr;
+}
+
+static bool gridgen_in_region(struct gridgen_usage *usage, int x, int y,
+                              int k)
+{
+    int region[5], nr = gridgen_regions(usage, x, y, region);
+
+    while (nr-- > 0)
+        if (region[nr] == k)
+            return true;
+    return false;
+}
+
+/* The set of digits already placed in a region. */
+static const candmask *gridgen_placed(struct gridgen_usage *usage, int k)
+{
+    int cr = usage->cr, nw = usage->nwords;
+
+    if (k < cr)
+        return usage->row + k*nw;
+    else if (k < 2*cr)
+        return usage->col + (k-cr)*nw;
+    else if (k < 3*cr)
+        return usage->blk + (k-2*cr)*nw;
+    else
+        return usage->diag + (k-3*cr)*nw;
+}
+
+/* The part of the full set of digits which lives in word w. */
+static candmask gridgen_digits(int cr, int w)
+{
+    if (w < (cr-1) / 64 || cr % 64 == 0)
+        return ~(candmask)0;
+    return MASKBIT(cr % 64) - 1;
+}
+
+/*
+ * Work out which digits are still possible in a square, leaving
+ * the set in avail and returning how many there are.
+ */
+static int gridgen_avail(struct gridgen_usage *usage, int x, int y,
+                         candmask *avail)
+{
+    int cr = usage->cr, nw = usage->nwords;
+    int xy = y*cr+x, w, m = 0;
+    const candmask *blk = usage->blk + usage->blocks->whichblock[xy]*nw;
+    const candmask *cge = NULL;
+
+    if (usage->cge)
+        cge = usage->cge + usage->kblocks->whichblock[xy]*nw;
+
+    for (w = 0; w < nw; w++) {
+        candmask used = usage->row[y*nw+w] | usage->col[x*nw+w] | blk[w];
+        if (cge)
+            used |= cge[w];
+        if (usage->diag) {
+            if (ondiag0(xy))
+                used |= usage->diag[w];
+            if (ondiag1(xy))
+                used |= usage->diag[nw+w];
+        }
+        avail[w] = ~used & gridgen_digits(cr, w);
+        m += bitcount(avail[w]);
+    }
+    return m;
+}
 
 /*
  * The real recursive step in the generating function.
@@ -2777,11 +3552,9 @@ static void gridgen_remove(struct gridgen_usage *usage, int x, int y, digit n)
  */
 static bool gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
 {
-    int cr = usage->cr;
-    int i, j, n, sx, sy, bestm, bestr;
-    bool ret;
-    int *digits;
-    unsigned int used;
+    int cr = usage->cr, nw = usage->nwords;
+    int i, j, k, w, sx, sy, bestm, bestr;
+    int *choices, nchoices;
 
     /*
      * Firstly, check for completion! If there are no spaces left
@@ -2803,96 +3576,124 @@ static bool gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
      */
     bestm = cr+1;                       /* so that any space will beat it */
     bestr = 0;
-    used = ~0;
     i = sx = sy = -1;
     for (j = 0; j < usage->nspaces; j++) {
         int x = usage->spaces[j].x, y = usage->spaces[j].y;
-        unsigned int used_xy;
-        int m;
-
-        m = usage->blocks->whichblock[y*cr+x];
-        used_xy = usage->row[y] | usage->col[x] | usage->blk[m];
-        if (usage->cge != NULL)
-            used_xy |= usage->cge[usage->kblocks->whichblock[y*cr+x]];
-        if (usage->cge != NULL)
-            used_xy |= usage->cge[usage->kblocks->whichblock[y*cr+x]];
-        if (usage->diag != NULL) {
-            if (ondiag0(y*cr+x))
-                used_xy |= usage->diag[0];
-            if (ondiag1(y*cr+x))
-                used_xy |= usage->diag[1];
-        }
+        candmask *avail = usage->avail + j*nw;
+        int m = gridgen_avail(usage, x, y, avail);
 
-        /*
-         * Find the number of digits that could go in this space.
-         */
-        m = 0;
-        for (n = 1; n <= cr; n++) {
-            unsigned int bit = 1 << n;
-            if ((used_xy & bit) == 0)
-                m++;
-        }
         if (m < bestm || (m == bestm && usage->spaces[j].r < bestr)) {
             bestm = m;
             bestr = usage->spaces[j].r;
             sx = x;
             sy = y;
             i = j;
-            used = used_xy;
         }
     }
 
     /*
-     * Swap that square into the final place in the spaces array,
-     * so that decrementing nspaces will remove it from the list.
+     * Now list the digits to try in that square, as square*cr +
+     * digit-1.
      */
-    if (i != usage->nspaces-1) {
-        struct gridgen_coord t;
-        t = usage->spaces[usage->nspaces-1];
-        usage->spaces[usage->nspaces-1] = usage->spaces[i];
-        usage->spaces[i] = t;
+    choices = usage->choices + (usage->maxspaces - usage->nspaces) * cr;
+    nchoices = 0;
+    for (w = 0; w < nw; w++) {
+        candmask avail = usage->avail[i*nw+w];
+        while (avail) {
+            choices[nchoices++] = (sy*cr+sx)*cr + w*64 + lowest_bit(avail);
+            avail &= avail - 1;
+        }
     }
 
     /*
-     * Now we've decided which square to start our recursion at,
-     * simply go through all possible values, shuffling them
-     * randomly first if necessary.
+     * If that square still has a choice of digits, look at it the
+     * other way round: a digit with only one place left to go in
+     * some row, column, block or diagonal has to go there, and a
+     * digit with nowhere left to go means we've already gone wrong.
+     * On large grids this catches dead ends long before the
+     * individual squares run out of digits.
+     *
+     * For each region we accumulate the digits possible in at least
+     * one of its spaces, and the ones possible in at least two.
      */
-    digits = snewn(bestm, int);
+    if (nchoices > 1) {
+        int nregions = usage->diag ? 3*cr+2 : 3*cr;
+        candmask *once = usage->once, *twice = usage->twice;
+        int region[5], nr;
+
+        memset(once, 0, nregions * nw * sizeof(candmask));
+        memset(twice, 0, nregions * nw * sizeof(candmask));
+        for (j = 0; j < usage->nspaces; j++) {
+            nr = gridgen_regions(usage, usage->spaces[j].x,
+                                 usage->spaces[j].y, region);
+            for (k = 0; k < nr; k++)
+                for (w = 0; w < nw; w++) {
+                    candmask a = usage->avail[j*nw+w];
+                    twice[region[k]*nw+w] |= once[region[k]*nw+w] & a;
+                    once[region[k]*nw+w] |= a;
+                }
+        }
 
-    j = 0;
-    for (n = 1; n <= cr; n++) {
-        unsigned int bit = 1 << n;
+        for (k = 0; k < nregions; k++)
+            for (w = 0; w < nw; w++) {
+                candmask single = once[k*nw+w] & ~twice[k*nw+w];
+
+                if ((once[k*nw+w] | gridgen_placed(usage, k)[w]) !=
+                    gridgen_digits(cr, w))
+                    return false;
+                if (single && nchoices > 1) {
+                    int n = w*64 + lowest_bit(single);
 
-        if ((used & bit) == 0)
-            digits[j++] = n;
+                    for (j = 0; j < usage->nspaces; j++)
+                        if ((usage->avail[j*nw+w] & MASKBIT(n % 64)) &&
+                            gridgen_in_region(usage, usage->spaces[j].x,
+                                              usage->spaces[j].y, k))
+                            break;
+                    assert(j < usage->nspaces);
+                    choices[0] = (usage->spaces[j].y*cr +
+                                  usage->spaces[j].x)*cr + n;
+                    nchoices = 1;
+                }
+            }
     }
 
     if (usage->rs)
-        shuffle(digits, j, sizeof(*digits), usage->rs);
+        shuffle(choices, nchoices, sizeof(*choices), usage->rs);
+
+    /* And finally, go through the choice list and actually recurse. */
+    for (i = 0; i < nchoices; i++) {
+        int xy = choices[i] / cr, x = xy % cr, y = xy / cr;
+        digit n = choices[i] % cr + 1;
 
-    /* And finally, go through the digit list and actually recurse. */
-    ret = false;
-    for (i = 0; i < j; i++) {
-        n = digits[i];
+        /*
+         * Swap that square into the final place in the spaces
+         * array, so that decrementing nspaces will remove it from
+         * the list.
+         */
+        for (k = usage->nspaces; k-- > 0 ;)
+            if (usage->spaces[k].x == x && usage->spaces[k].y == y)
+                break;
+        if (k != usage->nspaces-1) {
+            struct gridgen_coord t;
+            t = usage->spaces[usage->nspaces-1];
+            usage->spaces[usage->nspaces-1] = usage->spaces[k];
+            usage->spaces[k] = t;
+        }
 
         /* Update the usage structure to reflect the placing of this digit. */
-        gridgen_place(usage, sx, sy, n);
+        gridgen_place(usage, x, y, n);
         usage->nspaces--;
 
         /* Call the solver recursively. Stop when we find a solution. */
-        if (gridgen_real(usage, grid, steps)) {
-            ret = true;
-            break;
-        }
+        if (gridgen_real(usage, grid, steps))
+            return true;
 
         /* Revert the usage structure. */
-        gridgen_remove(usage, sx, sy, n);
+        gridgen_remove(usage, x, y, n);
         usage->nspaces++;
     }
 
-    sfree(digits);
-    return ret;
+    return false;
 }
 
 /*
@@ -2904,86 +3705,110 @@ static bool gridgen(int cr, struct block_structure *blocks,
                     digit *grid, random_state *rs, int maxsteps)
 {
     struct gridgen_usage *usage;
-    int x, y;
+    int x, y, nw = (cr + 63) / 64;
+    int steps;
     bool ret;
 
-    /*
-     * Clear the grid to start with.
-     */
-    memset(grid, 0, cr*cr);
-
     /*
      * Create a gridgen_usage structure.
      */
     usage = snew(struct gridgen_usage);
 
     usage->cr = cr;
+    usage->nwords = nw;
     usage->blocks = blocks;
 
     usage->grid = grid;
 
-    usage->row = snewn(cr, unsigned int);
-    usage->col = snewn(cr, unsigned int);
-    usage->blk = snewn(cr, unsigned int);
+    usage->row = snewn(cr * nw, candmask);
+    usage->col = snewn(cr * nw, candmask);
+    usage->blk = snewn(cr * nw, candmask);
     if (kblocks != NULL) {
         usage->kblocks = kblocks;
-        usage->cge = snewn(usage->kblocks->nr_blocks, unsigned int);
-        memset(usage->cge, 0, kblocks->nr_blocks * sizeof *usage->cge);
+        usage->cge = snewn(kblocks->nr_blocks * nw, candmask);
     } else {
         usage->cge = NULL;
     }
-
-    memset(usage->row, 0, cr * sizeof *usage->row);
-    memset(usage->col, 0, cr * sizeof *usage->col);
-    memset(usage->blk, 0, cr * sizeof *usage->blk);
-
-    if (xtype) {
-        usage->diag = snewn(2, unsigned int);
-        memset(usage->diag, 0, 2 * sizeof *usage->diag);
-    } else {
+    if (xtype)
+        usage->diag = snewn(2 * nw, candmask);
+    else
         usage->diag = NULL;
-    }
-
-    /*
-     * Begin by filling in the whole top row with randomly chosen
-     * numbers. This cannot introduce any bias or restriction on
-     * the available grids, since we already know those numbers
-     * are all distinct so all we're doing is choosing their
-     * labels.
-     */
-    for (x = 0; x < cr; x++)
-        grid[x] = x+1;
-    shuffle(grid, cr, sizeof(*grid), rs);
-    for (x = 0; x < cr; x++)
-        gridgen_place(usage, x, 0, grid[x]);
+    usage->avail = snewn(cr * cr * nw, candmask);
+    usage->once = snewn((3*cr+2) * nw, candmask);
+    usage->twice = snewn((3*cr+2) * nw, candmask);
 
     usage->spaces = snewn(cr * cr, struct gridgen_coord);
-    usage->nspaces = 0;
+    usage->maxspaces = cr * (cr-1);
+    usage->choices = snewn(usage->maxspaces * cr, int);
 
     usage->rs = rs;
 
-    /*
-     * Initialise the list of grid spaces, taking care to leave
-     * out the row I've already filled in above.
-     */
-    for (y = 1; y < cr; y++) {
-        for (x = 0; x < cr; x++) {
-            usage->spaces[usage->nspaces].x = x;
-            usage->spaces[usage->nspaces].y = y;
-            usage->spaces[usage->nspaces].r = random_bits(rs, 31);
-            usage->nspaces++;
+    while (1) {
+        /*
+         * Clear the grid and the bitsets to start with.
+         */
+        memset(grid, 0, cr*cr);
+        memset(usage->row, 0, cr * nw * sizeof(candmask));
+        memset(usage->col, 0, cr * nw * sizeof(candmask));
+        memset(usage->blk, 0, cr * nw * sizeof(candmask));
+        if (usage->cge)
+            memset(usage->cge, 0,
+                   kblocks->nr_blocks * nw * sizeof(candmask));
+        if (usage->diag)
+            memset(usage->diag, 0, 2 * nw * sizeof(candmask));
+
+        /*
+         * Begin by filling in the whole top row with randomly chosen
+         * numbers. This cannot introduce any bias or restriction on
+         * the available grids, since we already know those numbers
+         * are all distinct so all we're doing is choosing their
+         * labels.
+         */
+        for (x = 0; x < cr; x++)
+            grid[x] = x+1;
+        shuffle(grid, cr, sizeof(*grid), rs);
+        for (x = 0; x < cr; x++)
+            gridgen_place(usage, x, 0, grid[x]);
+
+        /*
+         * Initialise the list of grid spaces, taking care to leave
+         * out the row I've already filled in above.
+         */
+        usage->nspaces = 0;
+        for (y = 1; y < cr; y++) {
+            for (x = 0; x < cr; x++) {
+                usage->spaces[usage->nspaces].x = x;
+                usage->spaces[usage->nspaces].y = y;
+                usage->spaces[usage->nspaces].r = random_bits(rs, 31);
+                usage->nspaces++;
+            }
         }
-    }
 
-    /*
-     * Run the real generator function.
-     */
-    ret = gridgen_real(usage, grid, &maxsteps);
+        /*
+         * Run the real generator function. A fill that's going to
+         * work rarely needs much more than one step per space, while
+         * one that has gone wrong early can flounder for an
+         * enormous number of steps without ever backing out of its
+         * mistake; so rather than spend the whole allowance on one
+         * attempt, give each a few steps per space and start again
+         * with a fresh top row and fill order when it runs out.
+         */
+        steps = min(4 * cr * cr, maxsteps);
+        maxsteps -= steps;
+        ret = gridgen_real(usage, grid, &steps);
+        if (ret || maxsteps <= 0)
+            break;
+    }
 
     /*
      * Clean up the usage structure now we have our answer.
      */
+    sfree(usage->choices);
     sfree(usage->spaces);
+    sfree(usage->twice);
+    sfree(usage->once);
+    sfree(usage->avail);
+    sfree(usage->diag);
     sfree(usage->cge);
     sfree(usage->blk);
     sfree(usage->col);
@@ -3636,13 +4461,11 @@ static key_label *game_request_keys(const game_params *params, int *nkeys)
 {
     int i;
     int cr = params->c * params->r;
-    key_label *keys = snewn(cr+1, key_label);
+    key_label *keys = snewn(cr+3, key_label);
     *nkeys = cr + 3;
 
     for (i = 0; i < cr; i++) {
-        if (i<9) keys[i].button = '1' + i;
-        else keys[i].button = 'a' + i - 9;
-
+        keys[i].button = digit_char(i+1);
         keys[i].label = NULL;
     }
     keys[cr].button = '+';
@@ -3656,6 +4479,278 @@ static key_label *game_request_keys(const game_params *params, int *nkeys)
     return keys;
 }
 
+/*
+ * Once new_game_desc has a filled grid, it goes through the symmetry
+ * orbits of the grid in a random order, taking out the clues in each
+ * orbit if the puzzle is still within the difficulty limits without
+ * them. A stripper holds what's needed to judge one such removal.
+ */
+struct xy { int x, y; };
+
+struct stripper {
+    const game_params *params;
+    struct block_structure *blocks, *kblocks;
+    digit *kgrid;
+    struct difficulty dlev;
+    digit *grid2;                      /* the grid with the orbit removed */
+    struct dlx *dlx;                   /* solution counter, if we use one */
+};
+
+static struct stripper *stripper_new(const game_params *params,
+                                     struct block_structure *blocks,
+                                     struct block_structure *kblocks,
+                                     digit *kgrid,
+                                     const struct difficulty *dlev)
+{
+    struct stripper *st = snew(struct stripper);
+    int cr = params->c * params->r;
+
+    st->params = params;
+    st->blocks = blocks;
+    st->kblocks = kblocks;
+    st->kgrid = kgrid;
+    st->dlev = *dlev;
+    st->grid2 = snewn(cr*cr, digit);
+
+    /*
+     * At Unreasonable level all we need to know about each removal
+     * is whether it leaves the solution unique, which the solution
+     * counter can answer much faster than the solver. The solver
+     * still grades the finished puzzle.
+     */
+    st->dlx = NULL;
+    if (dlev->maxdiff == DIFF_RECURSIVE)
+        st->dlx = dlx_new(cr, blocks, kblocks, params->xtype, kgrid);
+
+    return st;
+}
+
+static void stripper_free(struct stripper *st)
+{
+    if (st->dlx)
+        dlx_free(st->dlx);
+    sfree(st->grid2);
+    sfree(st);
+}
+
+/* Clear the squares in the orbit of (x,y). */
+static void strip_orbit(const game_params *params, digit *grid, int x, int y)
+{
+    int cr = params->c * params->r;
+    int coords[16], ncoords, j;
+
+    ncoords = symmetries(params, x, y, coords, params->symm);
+    for (j = 0; j < ncoords; j++)
+        grid[coords[2*j+1]*cr+coords[2*j]] = 0;
+}
+
+/* See whether the clues left in grid2 still make an acceptable puzzle. */
+static bool stripper_judge(struct stripper *st)
+{
+    const game_params *params = st->params;
+    int cr = params->c * params->r;
+
+    if (st->dlx)
+        return dlx_count(st->dlx, st->grid2) == 1;
+
+    solver(cr, st->blocks, st->kblocks, params->xtype, st->grid2, st->kgrid,
+           &st->dlev);
+    return (st->dlev.diff <= st->dlev.maxdiff &&
+            (!params->killer || st->dlev.kdiff <= st->dlev.maxkdiff));
+}
+
+/*
+ * See whether the clues in the orbit of (x,y) can come out of grid.
+ * grid itself is left alone.
+ */
+static bool stripper_try(struct stripper *st, const digit *grid, int x, int y)
+{
+    const game_params *params = st->params;
+    int cr = params->c * params->r;
+
+    memcpy(st->grid2, grid, cr*cr);
+    strip_orbit(params, st->grid2, x, y);
+    return stripper_judge(st);
+}
+
+#ifdef SOLO_PARALLEL
+/*
+ * Number of threads to strip clues on. Zero means take it from the
+ * SOLO_THREADS environment variable, defaulting to one.
+ */
+static int solo_generator_threads = 0;
+
+/*
+ * Stripping in parallel. The threads judge a batch of the next few
+ * orbits at once, which means guessing the verdicts on the earlier
+ * orbits in the batch. We guess they'll all go the same way as the
+ * last verdict before the batch: removals tend to succeed while
+ * the grid is still full of clues and fail once it has thinned
+ * out. So if the guess is success, each orbit is judged with all
+ * the earlier ones in its batch removed as well; if failure, it's
+ * judged against the grid as it stands.
+ *
+ * Then we go through the verdicts in order, acting on each as the
+ * serial loop would. The first verdict that goes against the guess
+ * is still sound, since everything before it went as guessed, but
+ * the ones after it were judged against the wrong grid. Those are
+ * thrown away, and their orbits are judged again in the next
+ * batch. So exactly the same clues come out as they would one at a
+ * time.
+ */
+struct parallel_solo {
+    const game_params *params;
+    struct block_structure *blocks, *kblocks;
+    digit *kgrid;
+    const struct difficulty *dlev;
+    pthread_mutex_t lock;
+    pthread_cond_t start, finish;
+    const digit *grid;                 /* the grid as it stands */
+    const struct xy *batch;            /* the orbits being judged */
+    bool *ok;                          /* ... and the verdicts on them */
+    bool guess;                        /* guessed verdict on each */
+    int size;                          /* number of orbits in the batch */
+    int next;                          /* lowest orbit not yet claimed */
+    int pending;                       /* orbits not yet judged */
+    bool quit;
+};
+
+/*
+ * Judge orbits from the current batch until there are none left to
+ * claim. Called, and returns, with the lock held.
+ */
+static void parallel_judge_solo(struct parallel_solo *ctx,
+                                struct stripper *st)
+{
+    int cr = ctx->params->c * ctx->params->r;
+
+    while (ctx->next < ctx->size) {
+        int k = ctx->next++, j;
+        bool ok;
+
+        pthread_mutex_unlock(&ctx->lock);
+        memcpy(st->grid2, ctx->grid, cr*cr);
+        for (j = (ctx->guess ? 0 : k); j <= k; j++)
+            strip_orbit(ctx->params, st->grid2,
+                        ctx->batch[j].x, ctx->batch[j].y);
+        ok = stripper_judge(st);
+        pthread_mutex_lock(&ctx->lock);
+
+        ctx->ok[k] = ok;
+        if (--ctx->pending == 0)
+            pthread_cond_signal(&ctx->finish);
+    }
+}
+
+static void *strip_thread_solo(void *vctx)
+{
+    struct parallel_solo *ctx = (struct parallel_solo *)vctx;
+    struct stripper *st = stripper_new(ctx->params, ctx->blocks,
+                                       ctx->kblocks, ctx->kgrid, ctx->dlev);
+
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->quit) {
+        parallel_judge_solo(ctx, st);
+        if (!ctx->quit)
+            pthread_cond_wait(&ctx->start, &ctx->lock);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    stripper_free(st);
+    return NULL;
+}
+
+/*
+ * Strip the clues from grid on several threads. Returns false,
+ * having done nothing, if we're only meant to use one thread or
+ * can't start any more.
+ */
+static bool strip_parallel(const game_params *params,
+                           struct block_structure *blocks,
+                           struct block_structure *kblocks, digit *kgrid,
+                           const struct difficulty *dlev, digit *grid,
+                           const struct xy *locs, int nlocs)
+{
+    struct parallel_solo ctx;
+    struct stripper *st;
+    pthread_t *threads;
+    int nthreads = solo_generator_threads, started, i, k;
+
+    if (nthreads <= 0) {
+        const char *env = getenv("SOLO_THREADS");
+        nthreads = (env ? atoi(env) : 1);
+    }
+    if (nthreads <= 1)
+        return false;
+
+    ctx.params = params;
+    ctx.blocks = blocks;
+    ctx.kblocks = kblocks;
+    ctx.kgrid = kgrid;
+    ctx.dlev = dlev;
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.start, NULL);
+    pthread_cond_init(&ctx.finish, NULL);
+    ctx.grid = grid;
+    ctx.batch = NULL;
+    ctx.ok = snewn(nthreads, bool);
+    ctx.guess = true;
+    ctx.size = ctx.next = ctx.pending = 0;
+    ctx.quit = false;
+
+    /*
+     * This thread judges orbits too, so we need one fewer workers.
+     */
+    threads = snewn(nthreads - 1, pthread_t);
+    for (started = 0; started < nthreads - 1; started++)
+        if (pthread_create(&threads[started], NULL,
+                           strip_thread_solo, &ctx) != 0)
+            break;
+
+    if (started > 0) {
+        st = stripper_new(params, blocks, kblocks, kgrid, dlev);
+
+        pthread_mutex_lock(&ctx.lock);
+        for (i = 0; i < nlocs ;) {
+            ctx.batch = locs + i;
+            ctx.size = ctx.pending = min(started + 1, nlocs - i);
+            ctx.next = 0;
+            pthread_cond_broadcast(&ctx.start);
+
+            parallel_judge_solo(&ctx, st);
+            while (ctx.pending > 0)
+                pthread_cond_wait(&ctx.finish, &ctx.lock);
+
+            for (k = 0; k < ctx.size; k++) {
+                if (ctx.ok[k])
+                    strip_orbit(params, grid, locs[i+k].x, locs[i+k].y);
+                if (ctx.ok[k] != ctx.guess) {
+                    ctx.guess = ctx.ok[k];
+                    k++;
+                    break;
+                }
+            }
+            i += k;
+        }
+        ctx.quit = true;
+        pthread_cond_broadcast(&ctx.start);
+        pthread_mutex_unlock(&ctx.lock);
+
+        stripper_free(st);
+    }
+
+    for (k = 0; k < started; k++)
+        pthread_join(threads[k], NULL);
+    sfree(threads);
+    sfree(ctx.ok);
+    pthread_cond_destroy(&ctx.finish);
+    pthread_cond_destroy(&ctx.start);
+    pthread_mutex_destroy(&ctx.lock);
+
+    return started > 0;
+}
+#endif
+
 static char *new_game_desc(const game_params *params, random_state *rs,
                            char **aux, bool interactive)
 {
@@ -3663,11 +4758,11 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     int area = cr*cr;
     struct block_structure *blocks, *kblocks;
     digit *grid, *grid2, *kgrid;
-    struct xy { int x, y; } *locs;
+    struct xy *locs;
     int nlocs;
     char *desc;
     int coords[16], ncoords;
-    int x, y, i, j;
+    int x, y, i;
     struct difficulty dlev;
 
     precompute_sum_bits();
@@ -3857,21 +4952,19 @@ static char *new_game_desc(const game_params *params, random_state *rs,
          * see whether removing that element (and its reflections)
          * from the grid will still leave the grid soluble.
          */
-        for (i = 0; i < nlocs; i++) {
-            x = locs[i].x;
-            y = locs[i].y;
+#ifdef SOLO_PARALLEL
+        if (!strip_parallel(params, blocks, kblocks, kgrid, &dlev,
+                            grid, locs, nlocs))
+#endif
+        {
+            struct stripper *st = stripper_new(params, blocks, kblocks,
+                                               kgrid, &dlev);
 
-            memcpy(grid2, grid, area);
-            ncoords = symmetries(params, x, y, coords, params->symm);
-            for (j = 0; j < ncoords; j++)
-                grid2[coords[2*j+1]*cr+coords[2*j]] = 0;
+            for (i = 0; i < nlocs; i++)
+                if (stripper_try(st, grid, locs[i].x, locs[i].y))
+                    strip_orbit(params, grid, locs[i].x, locs[i].y);
 
-            solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
-            if (dlev.diff <= dlev.maxdiff &&
-                (!params->killer || dlev.kdiff <= dlev.maxkdiff)) {
-                for (j = 0; j < ncoords; j++)
-                    grid[coords[2*j+1]*cr+coords[2*j]] = 0;
-            }
+            stripper_free(st);
         }
 
         memcpy(grid2, grid, area);
@@ -4459,10 +5552,8 @@ static char *grid_text_format(int cr, struct block_structure *blocks,
                     ch = '_';
                 else
                     ch = '.';
-            } else if (d <= 9) {
-                ch = '0' + d;
             } else {
-                ch = 'a' + d-10;
+                ch = digit_char(d);
             }
 
             *p++ = ch;
@@ -4753,17 +5844,9 @@ static char *interpret_move(const game_state *state, game_ui *ui,
     }
 
     if (ui->hshow &&
-        ((button >= '0' && button <= '9' && button - '0' <= cr) ||
-         (button >= 'a' && button <= 'z' && button - 'a' + 10 <= cr) ||
-         (button >= 'A' && button <= 'Z' && button - 'A' + 10 <= cr) ||
+        (char_digit(button, cr) || button == '0' ||
          button == CURSOR_SELECT2 || button == '\b')) {
-        int n = button - '0';
-        if (button >= 'A' && button <= 'Z')
-            n = button - 'A' + 10;
-        if (button >= 'a' && button <= 'z')
-            n = button - 'a' + 10;
-        if (button == CURSOR_SELECT2 || button == '\b')
-            n = 0;
+        int n = char_digit(button, cr);
         ui->hhint = 0;
 
         /*
@@ -4787,16 +5870,8 @@ static char *interpret_move(const game_state *state, game_ui *ui,
 
         return dupstr(buf);
     }
-    if (!ui->hshow &&
-       ((button >= '0' && button <= '9' && button - '0' <= cr) ||
-        (button >= 'a' && button <= 'z' && button - 'a' + 10 <= cr) ||
-        (button >= 'A' && button <= 'Z' && button - 'A' + 10 <= cr))) {
-
-        int n = button - '0';
-        if (button >= 'A' && button <= 'Z')
-            n = button - 'A' + 10;
-        if (button >= 'a' && button <= 'z')
-            n = button - 'a' + 10;
+    if (!ui->hshow && (char_digit(button, cr) || button == '0')) {
+        int n = char_digit(button, cr);
 
         if (ui->hhint == n) ui->hhint = 0;
         else ui->hhint = n;
@@ -5218,9 +6293,7 @@ static void draw_number(drawing *dr, game_drawstate *ds,
     /* new number needs drawing? */
     if (state->grid[y*cr+x]) {
         str[1] = '\0';
-        str[0] = state->grid[y*cr+x] + '0';
-        if (str[0] > '9')
-            str[0] += 'a' - ('9'+1);
+        str[0] = digit_char(state->grid[y*cr+x]);
         draw_text(dr, tx + TILE_SIZE/2, ty + TILE_SIZE/2,
                   FONT_VARIABLE, TILE_SIZE/2, ALIGN_VCENTRE | ALIGN_HCENTRE,
                   state->immutable[y*cr+x] ? COL_CLUE : (hl & 16) ? COL_ERROR : COL_USER, str);
@@ -5323,9 +6396,7 @@ static void draw_number(drawing *dr, game_drawstate *ds,
                     int dx = j % pw, dy = j / pw;
 
                     str[1] = '\0';
-                    str[0] = i + '1';
-                    if (str[0] > '9')
-                        str[0] += 'a' - ('9'+1);
+                    str[0] = digit_char(i+1);
                     draw_text(dr, pl + fontsize * (2*dx+1) / 2,
                               pt + fontsize * (2*dy+1) / 2,
                               FONT_VARIABLE, fontsize,
@@ -5779,9 +6850,7 @@ static void game_print(drawing *dr, const game_state *state, int tilesize)
             if (state->grid[y*cr+x]) {
                 char str[2];
                 str[1] = '\0';
-                str[0] = state->grid[y*cr+x] + '0';
-                if (str[0] > '9')
-                    str[0] += 'a' - ('9'+1);
+                str[0] = digit_char(state->grid[y*cr+x]);
                 draw_text(dr, BORDER + x*TILE_SIZE + TILE_SIZE/2,
                           BORDER + y*TILE_SIZE + TILE_SIZE/2,
                           FONT_VARIABLE, TILE_SIZE/2,
@@ -2,15 +2,30 @@
 
  */
 
+#if defined(STANDALONE_SOLVER) || defined(WALLS_STATS)
+/* The solver timings use clock_gettime(), which is POSIX.1b. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <stdint.h>
 
 #include "puzzles.h"
 
+#if defined(STANDALONE_SOLVER) && !defined(WALLS_STATS)
+#define WALLS_STATS
+#endif
+#ifdef WALLS_STATS
+#include <time.h>
+#endif
+
 #define DIFFLIST(A) \
     A(EASY,Easy,e) \
     A(NORMAL,Normal,n) \
@@ -79,6 +94,10 @@ struct game_state {
     unsigned char *cellstate;
     bool completed;
     bool used_solve;
+    struct check_scratch *check;
+    int checked;            /* scratch generation the error flags match */
+    int nbad, nopen;        /* cells with too many paths or walls, and
+                             * cells with fewer than two paths */
 };
 
 #define DEFAULT_PRESET 1
@@ -92,7 +111,10 @@ static const struct game_params walls_presets[] = {
     {8, 8,  DIFF_TRICKY},
     {8, 8,  DIFF_HARD},
     {9, 9,  DIFF_TRICKY},
-    {9, 9,  DIFF_HARD}
+    {9, 9,  DIFF_HARD},
+    {12, 12, DIFF_TRICKY},
+    {16, 16, DIFF_TRICKY},
+    {20, 20, DIFF_TRICKY}
 };
 
 static game_params *default_params(void) {
@@ -250,73 +272,128 @@ static int neighbour(int vertex, void *vctx) {
         return -1;
 }
 
-static int check_solution(game_state *state, bool full) {
+/*
+ * Validation scratch, shared by every state of one game through a
+ * reference count, so checking a move allocates nothing.
+ *
+ * The loop, exit and connectivity analysis only looks at path edges.
+ * Its error marks are kept in mark_h, mark_v and mark_cell together with
+ * the FLAG_PATH bits they were computed from, and are reused as long as
+ * the path layout of the checked state is the same. The dsf keeps the
+ * path fragments of that layout, so that check_move can grow it edge by
+ * edge; gen counts the layouts the marks have held.
+ */
+struct check_scratch {
+    int refcount;
+    gridstate grid;
+    struct findloopstate *fls;
+    int *dsf;
+
+    bool cached;
+    int gen;
+    unsigned char *mark_h, *mark_v, *mark_cell;
+    bool loop_error, unconnected, mark_unconnected;
+    int exit_result;
+    int exit_count, exit1, exit2;
+    int nfrags;
+
+    int *moved, nmoved;             /* edges changed by the last move */
+    int *cells;                     /* cells next to those edges */
+    unsigned char *seen;
+};
+
+static struct check_scratch *new_check_scratch(int w, int h) {
+    struct check_scratch *cs = snew(struct check_scratch);
+    cs->refcount = 1;
+    cs->grid.w = w; cs->grid.h = h;
+    cs->grid.faces = snewn(w*h, unsigned char);
+    cs->fls = findloop_new_state(w*h);
+    cs->dsf = snewn(w*h, int);
+    cs->cached = false;
+    cs->gen = 0;
+    cs->mark_h = snewn(w*(h+1), unsigned char);
+    cs->mark_v = snewn((w+1)*h, unsigned char);
+    cs->mark_cell = snewn((w+2)*(h+2), unsigned char);
+    cs->moved = snewn(w*(h+1) + (w+1)*h, int);
+    cs->nmoved = 0;
+    cs->cells = snewn(w*h, int);
+    cs->seen = snewn(w*h, unsigned char);
+    memset(cs->seen, 0, w*h*sizeof(unsigned char));
+    return cs;
+}
+
+static void free_check_scratch(struct check_scratch *cs) {
+    if (--cs->refcount > 0) return;
+    sfree(cs->seen);
+    sfree(cs->cells);
+    sfree(cs->moved);
+    sfree(cs->mark_cell);
+    sfree(cs->mark_v);
+    sfree(cs->mark_h);
+    sfree(cs->dsf);
+    findloop_free_state(cs->fls);
+    sfree(cs->grid.faces);
+    sfree(cs);
+}
+
+/* Count the path edges on the grid border, returning the cells of the
+ * first and the last one found in exit1 and exit2 */
+static int count_exits(const unsigned char *edge_h, const unsigned char *edge_v,
+                       int w, int h, int *exit1, int *exit2) {
+    int i;
+    int exit_count = 0;
+    *exit1 = *exit2 = -1;
+    for (i=0;i<w;i++)
+        if ((edge_h[i] & FLAG_PATH) > 0x00) {
+            exit_count++;
+            if (*exit1 == -1) *exit1 = i; else *exit2 = i;
+        }
+    for (i=w*h;i<w*(h+1);i++)
+        if ((edge_h[i] & FLAG_PATH) > 0x00) {
+            exit_count++;
+            if (*exit1 == -1) *exit1 = i-w; else *exit2 = i-w;
+        }
+    for (i=0;i<(w+1)*h;i+=(w+1))
+        if ((edge_v[i] & FLAG_PATH) > 0x00) {
+            exit_count++;
+            if (*exit1 == -1) *exit1 = w*(i/(w+1)); else *exit2 = w*(i/(w+1));
+        }
+    for (i=w;i<(w+1)*h;i+=(w+1))
+        if ((edge_v[i] & FLAG_PATH) > 0x00) {
+            exit_count++;
+            if (*exit1 == -1) *exit1 = (w-1)+w*(i/(w+1)); else *exit2 = (w-1)+w*(i/(w+1));
+        }
+    return exit_count;
+}
+
+/* Find loops, stray exits and unconnected cells in the path layout held
+ * in the marks of the check scratch, marking errors there as well */
+static void analyse_paths(struct check_scratch *cs, int w, int h) {
     int x,y,i;
-    int count_walls;
-    int count_paths;
     unsigned char *edges[4];
+    unsigned char *edge_h = cs->mark_h;
+    unsigned char *edge_v = cs->mark_v;
+    unsigned char *cellstate = cs->mark_cell;
 
-    gridstate *grid;
-    struct findloopstate *fls;
+    gridstate *grid = &cs->grid;
+    struct findloopstate *fls = cs->fls;
     struct neighbour_ctx ctx;
 
     int exit_count, exit1, exit2;
 
-    int *dsf;
+    int *dsf = cs->dsf;
     int first_cell;
-    bool mark_unconnected = false;
 
-    int w = state->w;
-    int h = state->h;
-    int solved = SOLVED;
-
-    /* Reset error flags */
-    if (full) {
-        for (i=0;i<w*(h+1);i++) state->edge_h[i] &= ~FLAG_ERROR;
-        for (i=0;i<(w+1)*h;i++) state->edge_v[i] &= ~FLAG_ERROR;
-        for (i=0;i<(w+2)*(h+2);i++) state->cellstate[i] = FLAG_NONE;
-    }
-    
-    /* Check if every cell has exactly two paths. Mark error flag */
-    for (y=0;y<h;y++)
-    for (x=0;x<w;x++) {
-        count_walls = 0;
-        count_paths = 0;
-        edges[0] = state->edge_h + y*w + x;
-        edges[1] = edges[0] + w;
-        edges[2] = state->edge_v + y*(w+1) + x;
-        edges[3] = edges[2] + 1;
-        for (i=0;i<4;i++) {
-            if ((*edges[i] & FLAG_WALL) > 0x00) count_walls++;
-            if ((*edges[i] & FLAG_PATH) > 0x00) count_paths++;
-        }
-        if (full) {
-            if (count_paths < 2) solved = AMBIGUOUS;
-            if (count_paths > 2 || count_walls > 2) {
-                solved = INVALID;
-                state->cellstate[(x+1)+(y+1)*(w+2)] |= FLAG_ERROR;
-                for (i=0;i<4;i++) {
-                    if ((*edges[i] & FLAG_PATH) > 0x00) {
-                        *edges[i] |= FLAG_ERROR;
-                    }
-                }
-            }
-        }
-        else if ((count_walls != 2 || count_paths != 2)) return AMBIGUOUS;
-    }
-    if (!full) return SOLVED;
+    cs->loop_error = cs->unconnected = false;
+    cs->exit_result = SOLVED;
 
     /* Find path loops, mark as error */
-    grid = snew(gridstate);
-    grid->faces = snewn(w*h, unsigned char);
-    grid->w = w; grid->h = h;
-
     for (y=0;y<h;y++)
     for (x=0;x<w;x++) {
         i = x+y*w;
-        edges[0] = state->edge_h + y*w + x;
+        edges[0] = edge_h + y*w + x;
         edges[1] = edges[0] + w;
-        edges[2] = state->edge_v + y*(w+1) + x;
+        edges[2] = edge_v + y*(w+1) + x;
         edges[3] = edges[2] + 1;
         grid->faces[i] = BLANK;
         if ((*edges[0] & FLAG_PATH) > 0x00) grid->faces[i] |= U;
@@ -324,7 +401,6 @@ static int check_solution(game_state *state, bool full) {
         if ((*edges[2] & FLAG_PATH) > 0x00) grid->faces[i] |= L;
         if ((*edges[3] & FLAG_PATH) > 0x00) grid->faces[i] |= R;
     }
-    fls = findloop_new_state(w*h);
     ctx.grid = grid;
     if (findloop_run(fls, w*h, neighbour, &ctx)) {
         for (x = 0; x < w; x++) {
@@ -333,11 +409,11 @@ static int check_solution(game_state *state, bool full) {
             u = y*w + x;
             for (v = neighbour(u, &ctx); v >= 0; v = neighbour(-1, &ctx)) {
                 if (findloop_is_loop_edge(fls, u, v)) {
-                    solved = INVALID;
-                    state->cellstate[(x+1)+(y+1)*(w+2)] |= FLAG_ERROR;
-                    edges[0] = state->edge_h + y*w + x;
+                    cs->loop_error = true;
+                    cellstate[(x+1)+(y+1)*(w+2)] |= FLAG_ERROR;
+                    edges[0] = edge_h + y*w + x;
                     edges[1] = edges[0] + w;
-                    edges[2] = state->edge_v + y*(w+1) + x;
+                    edges[2] = edge_v + y*(w+1) + x;
                     edges[3] = edges[2] + 1;
                     for (i=0;i<4;i++)
                         if ((*edges[i] & FLAG_PATH) > 0x00) {
@@ -349,106 +425,372 @@ static int check_solution(game_state *state, bool full) {
         }
     }
 
-    findloop_free_state(fls);
-    sfree(grid->faces);
-    sfree(grid);
-
     /* Check for exactly two exits */
-    exit_count = 0; exit1 = exit2 = -1;
-    for (i=0;i<w;i++)
-        if ((state->edge_h[i] & FLAG_PATH) > 0x00) {
-            exit_count++;
-            if (exit1 == -1) exit1 = i; else exit2 = i;
-        }
-    for (i=w*h;i<w*(h+1);i++)
-        if ((state->edge_h[i] & FLAG_PATH) > 0x00) {
-            exit_count++;
-            if (exit1 == -1) exit1 = i-w; else exit2 = i-w;
-        }
-    for (i=0;i<(w+1)*h;i+=(w+1))
-        if ((state->edge_v[i] & FLAG_PATH) > 0x00) {
-            exit_count++;
-            if (exit1 == -1) exit1 = w*(i/(w+1)); else exit2 = w*(i/(w+1));
-        }
-    for (i=w;i<(w+1)*h;i+=(w+1))
-        if ((state->edge_v[i] & FLAG_PATH) > 0x00) {
-            exit_count++;
-            if (exit1 == -1) exit1 = (w-1)+w*(i/(w+1)); else exit2 = (w-1)+w*(i/(w+1));
-        }
+    exit_count = count_exits(edge_h, edge_v, w, h, &exit1, &exit2);
     if (exit_count < 2)
-        solved = AMBIGUOUS;
+        cs->exit_result = AMBIGUOUS;
     else if (exit_count > 2) {
-        solved = INVALID;
+        cs->exit_result = INVALID;
         for (i=0;i<w;i++)
-            if ((state->edge_h[i] & FLAG_PATH) > 0x00) {
-                state->edge_h[i] |= FLAG_ERROR;
+            if ((edge_h[i] & FLAG_PATH) > 0x00) {
+                edge_h[i] |= FLAG_ERROR;
                 x = 1+i%w; y = i/w;
-                state->cellstate[x+y*(w+2)] |= FLAG_ERROR;
+                cellstate[x+y*(w+2)] |= FLAG_ERROR;
             }
         for (i=w*h;i<w*(h+1);i++)
-            if ((state->edge_h[i] & FLAG_PATH) > 0x00) {
-                state->edge_h[i] |= FLAG_ERROR;
+            if ((edge_h[i] & FLAG_PATH) > 0x00) {
+                edge_h[i] |= FLAG_ERROR;
                 x = 1+i%w; y = 1+i/w;
-                state->cellstate[x+y*(w+2)] |= FLAG_ERROR;
+                cellstate[x+y*(w+2)] |= FLAG_ERROR;
             }
         for (i=0;i<(w+1)*h;i+=(w+1))
-            if ((state->edge_v[i] & FLAG_PATH) > 0x00) {
-                state->edge_v[i] |= FLAG_ERROR;
+            if ((edge_v[i] & FLAG_PATH) > 0x00) {
+                edge_v[i] |= FLAG_ERROR;
                 x = i%(w+1); y = 1+i/(w+1);
-                state->cellstate[x+y*(w+2)] |= FLAG_ERROR;
+                cellstate[x+y*(w+2)] |= FLAG_ERROR;
             }
         for (i=w;i<(w+1)*h;i+=(w+1))
-            if ((state->edge_v[i] & FLAG_PATH) > 0x00) {
-                state->edge_v[i] |= FLAG_ERROR;
+            if ((edge_v[i] & FLAG_PATH) > 0x00) {
+                edge_v[i] |= FLAG_ERROR;
                 x = 1+i%(w+1); y = 1+i/(w+1);
-                state->cellstate[x+y*(w+2)] |= FLAG_ERROR;
+                cellstate[x+y*(w+2)] |= FLAG_ERROR;
             }
     }
 
     /* Check if all cells are connected */
-    dsf = snewn(w*h,int);
     dsf_init(dsf, w*h);
     for (y=0;y<h;y++)
     for (x=0;x<w;x++) {
         i = x+y*w;
-        edges[0] = state->edge_h + y*w + x;
+        edges[0] = edge_h + y*w + x;
         edges[1] = edges[0] + w;
-        edges[2] = state->edge_v + y*(w+1) + x;
+        edges[2] = edge_v + y*(w+1) + x;
         edges[3] = edges[2] + 1;
         if ((*edges[0] & FLAG_PATH) > 0x00 && y>0)   dsf_merge(dsf, i, i-w);
         if ((*edges[1] & FLAG_PATH) > 0x00 && y<h-1) dsf_merge(dsf, i, i+w);
         if ((*edges[2] & FLAG_PATH) > 0x00 && x>0)   dsf_merge(dsf, i, i-1);
         if ((*edges[3] & FLAG_PATH) > 0x00 && x<w-1) dsf_merge(dsf, i, i+1);
     }
+    cs->exit_count = exit_count;
+    cs->exit1 = exit1; cs->exit2 = exit2;
+    cs->mark_unconnected = false;
+    cs->nfrags = 0;
     first_cell = dsf_canonify(dsf, 0);
     if (exit_count == 2 && dsf_canonify(dsf, exit1) == dsf_canonify(dsf, exit2)) {
-        mark_unconnected = true;
+        cs->mark_unconnected = true;
         first_cell = dsf_canonify(dsf, exit1);
     }
     for (i=0;i<w*h;i++) {
+        if (dsf_canonify(dsf, i) == i) cs->nfrags++;
         if (dsf_canonify(dsf, i) != first_cell) {
-            solved = INVALID;
-            if (mark_unconnected) {
+            cs->unconnected = true;
+            if (cs->mark_unconnected) {
                 x = i%w; y=i/w;
+                cellstate[(x+1)+(y+1)*(w+2)] |= FLAG_ERROR;
+            }
+        }
+    }
+}
+
+static int check_solution(game_state *state, bool full) {
+    int x,y,i;
+    int count_walls;
+    int count_paths;
+    unsigned char *edges[4];
+    bool changed;
+    struct check_scratch *cs = state->check;
+
+    int w = state->w;
+    int h = state->h;
+    int solved = SOLVED;
+
+    /* Reset error flags */
+    if (full) {
+        for (i=0;i<w*(h+1);i++) state->edge_h[i] &= ~FLAG_ERROR;
+        for (i=0;i<(w+1)*h;i++) state->edge_v[i] &= ~FLAG_ERROR;
+        for (i=0;i<(w+2)*(h+2);i++) state->cellstate[i] = FLAG_NONE;
+        state->nbad = state->nopen = 0;
+    }
+    
+    /* Check if every cell has exactly two paths. Mark error flag */
+    for (y=0;y<h;y++)
+    for (x=0;x<w;x++) {
+        count_walls = 0;
+        count_paths = 0;
+        edges[0] = state->edge_h + y*w + x;
+        edges[1] = edges[0] + w;
+        edges[2] = state->edge_v + y*(w+1) + x;
+        edges[3] = edges[2] + 1;
+        for (i=0;i<4;i++) {
+            if ((*edges[i] & FLAG_WALL) > 0x00) count_walls++;
+            if ((*edges[i] & FLAG_PATH) > 0x00) count_paths++;
+        }
+        if (full) {
+            if (count_paths < 2) state->nopen++;
+            if (count_paths > 2 || count_walls > 2) {
+                state->nbad++;
                 state->cellstate[(x+1)+(y+1)*(w+2)] |= FLAG_ERROR;
+                for (i=0;i<4;i++) {
+                    if ((*edges[i] & FLAG_PATH) > 0x00) {
+                        *edges[i] |= FLAG_ERROR;
+                    }
+                }
+            }
+        }
+        else if ((count_walls != 2 || count_paths != 2)) return AMBIGUOUS;
+    }
+    if (!full) return SOLVED;
+    if (state->nopen > 0) solved = AMBIGUOUS;
+    if (state->nbad > 0) solved = INVALID;
+
+    /* Re-run the path analysis only if a path edge changed since the
+     * last check */
+    changed = !cs->cached;
+    for (i=0;i<w*(h+1) && !changed;i++)
+        if ((state->edge_h[i] & FLAG_PATH) != (cs->mark_h[i] & FLAG_PATH)) changed = true;
+    for (i=0;i<(w+1)*h && !changed;i++)
+        if ((state->edge_v[i] & FLAG_PATH) != (cs->mark_v[i] & FLAG_PATH)) changed = true;
+    if (changed) {
+        for (i=0;i<w*(h+1);i++) cs->mark_h[i] = state->edge_h[i] & FLAG_PATH;
+        for (i=0;i<(w+1)*h;i++) cs->mark_v[i] = state->edge_v[i] & FLAG_PATH;
+        memset(cs->mark_cell, FLAG_NONE, (w+2)*(h+2)*sizeof(unsigned char));
+        analyse_paths(cs, w, h);
+        cs->cached = true;
+        cs->gen++;
+    }
+    state->checked = cs->gen;
+
+    for (i=0;i<w*(h+1);i++)     state->edge_h[i]    |= cs->mark_h[i] & FLAG_ERROR;
+    for (i=0;i<(w+1)*h;i++)     state->edge_v[i]    |= cs->mark_v[i] & FLAG_ERROR;
+    for (i=0;i<(w+2)*(h+2);i++) state->cellstate[i] |= cs->mark_cell[i];
+    if (cs->loop_error) solved = INVALID;
+    if (cs->exit_result != SOLVED) solved = cs->exit_result;
+    if (cs->unconnected) solved = INVALID;
+
+    return solved;
+}
+
+/* The cells on either side of an edge in move numbering; -1 outside */
+static void edge_cells(int edge, int w, int h, int *a, int *b) {
+    int x, y;
+    if (edge < w*(h+1)) {
+        x = edge%w; y = edge/w;
+        *a = y > 0 ? x+(y-1)*w : -1;
+        *b = y < h ? x+y*w     : -1;
+    }
+    else {
+        edge -= w*(h+1);
+        x = edge%(w+1); y = edge/(w+1);
+        *a = x > 0 ? (x-1)+y*w : -1;
+        *b = x < w ? x+y*w     : -1;
+    }
+}
+
+/* Bit 1: cell has too many paths or walls, bit 2: fewer than two paths */
+static int cell_status(const game_state *state, int cell) {
+    int w = state->w;
+    int x = cell%w, y = cell/w;
+    int i, count_walls = 0, count_paths = 0;
+    const unsigned char *edges[4];
+
+    edges[0] = state->edge_h + y*w + x;
+    edges[1] = edges[0] + w;
+    edges[2] = state->edge_v + y*(w+1) + x;
+    edges[3] = edges[2] + 1;
+    for (i=0;i<4;i++) {
+        if ((*edges[i] & FLAG_WALL) > 0x00) count_walls++;
+        if ((*edges[i] & FLAG_PATH) > 0x00) count_paths++;
+    }
+    return ((count_paths > 2 || count_walls > 2) ? 1 : 0) |
+           (count_paths < 2 ? 2 : 0);
+}
+
+/*
+ * Check a state made from old by changing the edges listed in the check
+ * scratch's moved array. As long as the marks hold no errors (no loop,
+ * at most two exits, and those not yet joined), newly laid paths are
+ * merged into the fragment dsf one by one, and only the cells next to a
+ * changed edge and the borders of those cells are looked at again.
+ * Erased paths, a closed loop or anything that needs marks falls back to
+ * check_solution.
+ */
+static int check_move(game_state *state, const game_state *old) {
+    struct check_scratch *cs = state->check;
+    int w = state->w;
+    int h = state->h;
+    int i, j, a, b, c, x, y, e, ncells;
+    int old_status, new_status;
+    bool changed = false;
+    unsigned char *edge, *mark;
+    int solved = SOLVED;
+
+    if (cs->nmoved < 0 || !cs->cached || state->checked != cs->gen ||
+        cs->loop_error || cs->exit_count > 2 || cs->mark_unconnected)
+        return check_solution(state, true);
+
+    for (i=0;i<cs->nmoved;i++) {
+        e = cs->moved[i];
+        edge = e < w*(h+1) ? state->edge_h + e : state->edge_v + e - w*(h+1);
+        mark = e < w*(h+1) ? cs->mark_h + e    : cs->mark_v + e - w*(h+1);
+        if ((*mark & FLAG_PATH) > 0x00 && (*edge & FLAG_PATH) == 0x00)
+            return check_solution(state, true);
+    }
+
+    for (i=0;i<cs->nmoved;i++) {
+        e = cs->moved[i];
+        edge = e < w*(h+1) ? state->edge_h + e : state->edge_v + e - w*(h+1);
+        mark = e < w*(h+1) ? cs->mark_h + e    : cs->mark_v + e - w*(h+1);
+        if ((*mark & FLAG_PATH) > 0x00 || (*edge & FLAG_PATH) == 0x00)
+            continue;
+        edge_cells(e, w, h, &a, &b);
+        if (a >= 0 && b >= 0) {
+            a = dsf_canonify(cs->dsf, a);
+            b = dsf_canonify(cs->dsf, b);
+            if (a == b) {
+                cs->cached = false;
+                return check_solution(state, true);
             }
+            dsf_merge(cs->dsf, a, b);
+            cs->nfrags--;
+        }
+        *mark |= FLAG_PATH;
+        changed = true;
+    }
+
+    if (changed) {
+        cs->gen++;
+        cs->exit_count = count_exits(cs->mark_h, cs->mark_v, w, h,
+                                     &cs->exit1, &cs->exit2);
+        cs->exit_result = cs->exit_count < 2 ? AMBIGUOUS : SOLVED;
+        cs->unconnected = cs->nfrags > 1;
+        if (cs->exit_count > 2 || (cs->exit_count == 2 &&
+            dsf_canonify(cs->dsf, cs->exit1) == dsf_canonify(cs->dsf, cs->exit2))) {
+            cs->cached = false;
+            return check_solution(state, true);
+        }
+    }
+
+    /* The marks are clear, so the error flags come from the cell degrees
+     * alone */
+    ncells = 0;
+    for (i=0;i<cs->nmoved;i++) {
+        edge_cells(cs->moved[i], w, h, &a, &b);
+        if (a >= 0 && !cs->seen[a]) { cs->seen[a] = 1; cs->cells[ncells++] = a; }
+        if (b >= 0 && !cs->seen[b]) { cs->seen[b] = 1; cs->cells[ncells++] = b; }
+    }
+    for (i=0;i<ncells;i++) {
+        c = cs->cells[i];
+        cs->seen[c] = 0;
+        old_status = cell_status(old, c);
+        new_status = cell_status(state, c);
+        state->nbad  += (new_status & 1) - (old_status & 1);
+        state->nopen += ((new_status & 2) - (old_status & 2)) / 2;
+        state->cellstate[(c%w+1)+(c/w+1)*(w+2)] = (new_status & 1) ? FLAG_ERROR : FLAG_NONE;
+    }
+    for (i=0;i<ncells;i++) {
+        c = cs->cells[i];
+        x = c%w; y = c/w;
+        for (j=0;j<2;j++) {
+            edge = state->edge_h + x + (y+j)*w;
+            *edge &= ~FLAG_ERROR;
+            if ((*edge & FLAG_PATH) > 0x00)
+                *edge |= (state->cellstate[(x+1)+(y+j)*(w+2)] |
+                          state->cellstate[(x+1)+(y+j+1)*(w+2)]) & FLAG_ERROR;
+            edge = state->edge_v + (x+j) + y*(w+1);
+            *edge &= ~FLAG_ERROR;
+            if ((*edge & FLAG_PATH) > 0x00)
+                *edge |= (state->cellstate[(x+j)+(y+1)*(w+2)] |
+                          state->cellstate[(x+j+1)+(y+1)*(w+2)]) & FLAG_ERROR;
         }
     }
-    sfree(dsf);
 
+    if (state->nopen > 0) solved = AMBIGUOUS;
+    if (state->nbad > 0) solved = INVALID;
+    if (cs->exit_result != SOLVED) solved = cs->exit_result;
+    if (cs->unconnected) solved = INVALID;
+    state->checked = cs->gen;
     return solved;
 }
 
+/*
+ * Optional solver and generator telemetry, compiled in with WALLS_STATS
+ * (which the standalone solver always defines). Each solver technique
+ * is counted and timed every time walls_solve tries it; the generator
+ * adds the number of candidate mazes it built and how many of those
+ * turned out too easy, and the time spent laying Hamiltonian paths.
+ */
+#define TECHLIST(A) \
+    A(SINGLE_CELLS,single_cells) \
+    A(EARLY_EXITS,early_exits) \
+    A(LOOPS,loops) \
+    A(PARTITIONS,partitions) \
+    A(LOOP_LADDERS,loop_ladders) \
+    A(EXIT_PARITY,exit_parity) \
+    A(PARITY,parity)
+#define TECH_ENUM(upper,lower) TECH_ ## upper,
+#define TECH_NAME(upper,lower) #lower,
+enum { TECHLIST(TECH_ENUM) NTECH };
+
+struct walls_stats {
+    unsigned long solves;
+    unsigned long tries[NTECH], hits[NTECH];
+    double seconds[NTECH];
+
+    unsigned long candidates;       /* mazes built by new_game_desc */
+    unsigned long too_easy;         /* ... rejected as below difficulty */
+    double path_seconds;            /* time spent laying paths */
+};
+
+#ifdef WALLS_STATS
+static struct walls_stats walls_total_stats;
+
+static double stats_clock(void) {
+#if defined(__unix__) || defined(__APPLE__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+#ifdef STANDALONE_SOLVER
+static const char *const walls_technames[] = { TECHLIST(TECH_NAME) };
+
+/* Copy out the totals collected so far, and optionally reset them. */
+static void walls_get_stats(struct walls_stats *out, bool reset) {
+    *out = walls_total_stats;
+    if (reset) memset(&walls_total_stats, 0, sizeof(walls_total_stats));
+}
+#endif
+#endif
+
+/* Number of earlier parity passes whose decided-edge sums are kept */
+#define PARITY_SNAPSHOTS 4
+
 struct solver_scratch {
+    int w, h;
     int *loopdsf;
-    bool *done_islands;
-    int island_counter;
+    int *pathdsf;
+    unsigned char *faces;
+    struct findloopstate *fls;
+    int loop_paths, partition_walls;
+    int *sum_h, *sum_v;
+    /* Sums seen by recent parity passes, newest last (see solve_parity) */
+    int *snap_h[PARITY_SNAPSHOTS], *snap_v[PARITY_SNAPSHOTS];
+    int snap_reach[PARITY_SNAPSHOTS];
+    int nsnaps;
+    int *blockdsf;
+    int *grouphead, *groupnext, *grouptail, *groupcells;
+    /* Edge planes, one word per row of edges (see solve_single_cells) */
+    uint64_t *hwall, *hpath, *hfree;
+    uint64_t *vwall, *vpath, *vfree;
     bool exits_found;
     int difficulty;
     bool verbose;
 };
 
-static bool solve_single_cells(game_state *state, struct solver_scratch *scratch) {
+static bool solve_single_cells_bytes(game_state *state, struct solver_scratch *scratch) {
     int i, j, x, y;
     bool changed = false;
     int w = state->w;
@@ -504,6 +846,168 @@ static bool solve_single_cells(game_state *state, struct solver_scratch *scratch
     return changed;
 }
 
+/*
+ * Bitboard form of the edges for the single cell rules. Each row of
+ * horizontal edges (w bits) and of vertical edges (w+1 bits) becomes one
+ * word in each of three planes: wall, path and undecided. A row of cells
+ * then sees its four sides as whole words - U and D are horizontal rows
+ * y and y+1, L and R are vertical row y unshifted and shifted by one.
+ * Boards too wide for a word fall back to the byte-wise rules.
+ */
+#define PLANE_MAX_W 63
+
+static void load_planes(const game_state *state, struct solver_scratch *scratch) {
+    int x,y;
+    int w = state->w;
+    int h = state->h;
+    unsigned char e;
+
+    for (y=0;y<=h;y++) {
+        uint64_t wl = 0, pt = 0, fr = 0;
+        for (x=w-1;x>=0;x--) {
+            e = state->edge_h[y*w+x];
+            wl <<= 1; pt <<= 1; fr <<= 1;
+            if (e == FLAG_NONE)   fr |= 1;
+            else if (e & FLAG_PATH) pt |= 1;
+            else if (e & FLAG_WALL) wl |= 1;
+        }
+        scratch->hwall[y] = wl; scratch->hpath[y] = pt; scratch->hfree[y] = fr;
+    }
+    for (y=0;y<h;y++) {
+        uint64_t wl = 0, pt = 0, fr = 0;
+        for (x=w;x>=0;x--) {
+            e = state->edge_v[y*(w+1)+x];
+            wl <<= 1; pt <<= 1; fr <<= 1;
+            if (e == FLAG_NONE)   fr |= 1;
+            else if (e & FLAG_PATH) pt |= 1;
+            else if (e & FLAG_WALL) wl |= 1;
+        }
+        scratch->vwall[y] = wl; scratch->vpath[y] = pt; scratch->vfree[y] = fr;
+    }
+}
+
+/* Per bit position, whether exactly two / fewer than two of a..d are set */
+static inline void count4(uint64_t a, uint64_t b, uint64_t c, uint64_t d,
+                          uint64_t *two, uint64_t *less) {
+    uint64_t s1 = a ^ b, c1 = a & b;
+    uint64_t s2 = c ^ d, c2 = c & d;
+    uint64_t ones = s1 ^ s2;
+    uint64_t carry = s1 & s2;
+    uint64_t twos = c1 ^ c2 ^ carry;
+    uint64_t fours = (c1 & c2) | ((c1 ^ c2) & carry);
+    *two = ~ones & twos & ~fours;
+    *less = ~twos & ~fours;
+}
+
+static void set_edge_single(game_state *state, struct solver_scratch *scratch,
+                            bool horizontal, int x, int y, unsigned char flag) {
+    int w = state->w;
+    int h = state->h;
+    int cx, cy, j;
+    char dir;
+
+    if (horizontal) {
+        state->edge_h[y*w+x] = flag;
+        cx = x; cy = (y < h) ? y : y-1; dir = (y < h) ? 'U' : 'D';
+    }
+    else {
+        state->edge_v[y*(w+1)+x] = flag;
+        cx = (x < w) ? x : x-1; cy = y; dir = (x < w) ? 'L' : 'R';
+    }
+    if (scratch->verbose)
+        printf("Set %s in cell %i/%i at %c\n", flag == FLAG_PATH ? "path" : "wall",
+               cx, cy, dir);
+    if (flag == FLAG_PATH && scratch->difficulty >= DIFF_NORMAL) {
+        j = x+y*w;
+        if (horizontal && y>0 && y<h)  dsf_merge(scratch->loopdsf, j-w, j);
+        if (!horizontal && x>0 && x<w) dsf_merge(scratch->loopdsf, j-1, j);
+    }
+}
+
+static bool solve_single_cells(game_state *state, struct solver_scratch *scratch) {
+    int x, y;
+    int w = state->w;
+    int h = state->h;
+    uint64_t mask, m;
+    uint64_t *hw = scratch->hwall, *hp = scratch->hpath, *hf = scratch->hfree;
+    uint64_t *vw = scratch->vwall, *vp = scratch->vpath, *vf = scratch->vfree;
+    bool progress, changed = false;
+
+    if (w > PLANE_MAX_W) return solve_single_cells_bytes(state, scratch);
+
+    mask = ((uint64_t)1 << w) - 1;
+    load_planes(state, scratch);
+
+    /* Run the rules to a fixpoint on the planes. Each sweep decides from
+     * the planes as they were when it started; cells sharing an edge
+     * never disagree on a consistent board, and paths win if they do. */
+    do {
+        uint64_t addhp[2], addhw[2];
+        uint64_t carry_p = 0, carry_w = 0;  /* additions to row y's top edges */
+
+        progress = false;
+        for (y=0;y<h;y++) {
+            uint64_t uw = hw[y],   up = hp[y],   uf = hf[y];
+            uint64_t dw = hw[y+1], dp = hp[y+1], df = hf[y+1];
+            uint64_t lw = vw[y] & mask,        lp = vp[y] & mask,        lf = vf[y] & mask;
+            uint64_t rw = (vw[y] >> 1) & mask, rp = (vp[y] >> 1) & mask, rf = (vf[y] >> 1) & mask;
+            uint64_t walls2, walls_lt2, paths2, paths_lt2;
+            uint64_t setpath, setwall, addvp, addvw;
+
+            count4(uw, dw, lw, rw, &walls2, &walls_lt2);
+            count4(up, dp, lp, rp, &paths2, &paths_lt2);
+            /* two walls -> remaining sides are paths;
+             * two paths -> remaining sides are walls */
+            setpath = walls2 & paths_lt2 & mask;
+            setwall = paths2 & walls_lt2 & ~setpath & mask;
+            if (!(setpath | setwall)) {
+                hp[y] |= carry_p; hf[y] &= ~carry_p;
+                hw[y] |= carry_w & ~hp[y]; hf[y] &= ~carry_w;
+                carry_p = carry_w = 0;
+                continue;
+            }
+
+            addhp[0] = setpath & uf; addhp[1] = setpath & df;
+            addhw[0] = setwall & uf; addhw[1] = setwall & df;
+            addvp = (setpath & lf) | ((setpath & rf) << 1);
+            addvw = (setwall & lf) | ((setwall & rf) << 1);
+
+            hp[y] |= carry_p | addhp[0];
+            hw[y] |= (carry_w | addhw[0]) & ~hp[y];
+            hf[y] &= ~(hp[y] | hw[y]);
+            carry_p = addhp[1]; carry_w = addhw[1];
+            vp[y] |= addvp;
+            vw[y] |= addvw & ~vp[y];
+            vf[y] &= ~(vp[y] | vw[y]);
+            progress = true;
+        }
+        hp[h] |= carry_p;
+        hw[h] |= carry_w & ~hp[h];
+        hf[h] &= ~(hp[h] | hw[h]);
+        if (progress) changed = true;
+    } while (progress);
+
+    if (!changed) return false;
+
+    /* Write the newly decided edges back to the byte layout */
+    for (y=0;y<=h;y++) {
+        m = (hp[y] | hw[y]) & mask;
+        for (x=0;m;x++,m>>=1)
+            if ((m & 1) && state->edge_h[y*w+x] == FLAG_NONE)
+                set_edge_single(state, scratch, true, x, y,
+                                (hp[y] >> x) & 1 ? FLAG_PATH : FLAG_WALL);
+    }
+    for (y=0;y<h;y++) {
+        m = vp[y] | vw[y];
+        for (x=0;m;x++,m>>=1)
+            if ((m & 1) && state->edge_v[y*(w+1)+x] == FLAG_NONE)
+                set_edge_single(state, scratch, false, x, y,
+                                (vp[y] >> x) & 1 ? FLAG_PATH : FLAG_WALL);
+    }
+
+    return true;
+}
+
 static bool solve_loop_ladders(game_state *state, struct solver_scratch *scratch) {
     int i,x,y,p,idx;
     unsigned char *edges[4];
@@ -590,17 +1094,32 @@ static bool solve_loop_ladders(game_state *state, struct solver_scratch *scratch
     return changed;
 }
 
-static bool check_partition(const game_state *state) {
-    int i,x,y;
+/* Number of edges with the given flag set, on the border or inside */
+static int count_flagged(const game_state *state, unsigned char flag) {
+    int i, n = 0;
+    for (i=0;i<state->w*(state->h+1);i++) if (state->edge_h[i] & flag) n++;
+    for (i=0;i<(state->w+1)*state->h;i++) if (state->edge_v[i] & flag) n++;
+    return n;
+}
+
+static bool solve_partitions(game_state *state, struct solver_scratch *scratch) {
+    int i,x,y,u,v;
     int w = state->w;
     int h = state->h;
     unsigned char *edges[4];
-    int *dsf;
-    int first_cell;
-
-    /* Check if all cells can be connected */
-    dsf = snewn(w*h,int);
-    dsf_init(dsf, w*h);
+    bool changed = false;
+    gridstate grid;
+    struct neighbour_ctx ctx;
+    int walls = count_flagged(state, FLAG_WALL);
+
+    /* Walling an edge splits the board exactly when that edge is a bridge
+     * of the graph of non-wall edges, so one findloop pass finds them all.
+     * All of those are paths afterwards, and only a new wall can make
+     * another bridge. */
+    if (walls == scratch->partition_walls) return false;
+    scratch->partition_walls = walls;
+    grid.w = w; grid.h = h;
+    grid.faces = scratch->faces;
     for (y=0;y<h;y++)
     for (x=0;x<w;x++) {
         i = x+y*w;
@@ -608,56 +1127,85 @@ static bool check_partition(const game_state *state) {
         edges[1] = edges[0] + w;
         edges[2] = state->edge_v + y*(w+1) + x;
         edges[3] = edges[2] + 1;
-        if ((*edges[0] & FLAG_WALL) == 0x00 && y>0)   dsf_merge(dsf, i, i-w);
-        if ((*edges[1] & FLAG_WALL) == 0x00 && y<h-1) dsf_merge(dsf, i, i+w);
-        if ((*edges[2] & FLAG_WALL) == 0x00 && x>0)   dsf_merge(dsf, i, i-1);
-        if ((*edges[3] & FLAG_WALL) == 0x00 && x<w-1) dsf_merge(dsf, i, i+1);
+        grid.faces[i] = BLANK;
+        if ((*edges[0] & FLAG_WALL) == 0x00) grid.faces[i] |= U;
+        if ((*edges[1] & FLAG_WALL) == 0x00) grid.faces[i] |= D;
+        if ((*edges[2] & FLAG_WALL) == 0x00) grid.faces[i] |= L;
+        if ((*edges[3] & FLAG_WALL) == 0x00) grid.faces[i] |= R;
+    }
+    ctx.grid = &grid;
+    findloop_run(scratch->fls, w*h, neighbour, &ctx);
+
+    for (i=w;i<w*h;i++) {
+        u = i-w; v = i;
+        if (state->edge_h[i] == FLAG_NONE &&
+            findloop_is_bridge(scratch->fls, u, v, NULL, NULL)) {
+            if (scratch->verbose)
+                printf("Horizontal edge at %i would partition the board -> set to path\n",i);
+            state->edge_h[i] = FLAG_PATH;
+            changed = true;
+        }
     }
-    first_cell = dsf_canonify(dsf, 0);
-    for (i=0;i<w*h;i++) {
-        if (dsf_canonify(dsf, i) != first_cell) {
-            sfree(dsf);
-            return false;
+    for (y=0;y<h;y++)
+    for (x=1;x<w;x++) {
+        i = y*(w+1)+x;
+        u = y*w+x-1; v = y*w+x;
+        if (state->edge_v[i] == FLAG_NONE &&
+            findloop_is_bridge(scratch->fls, u, v, NULL, NULL)) {
+            if (scratch->verbose)
+                printf("Vertical edge at %i would partition the board -> set to path\n",i);
+            state->edge_v[i] = FLAG_PATH;
+            changed = true;
         }
     }
-    sfree(dsf);
-    return true;
+
+    return changed;
 }
 
-static bool solve_partitions(game_state *state, struct solver_scratch *scratch) {
-    int i;
+static inline bool parity(int x, int y) {
+    return (x^y)&1;
+}
+
+/*
+ * Two-dimensional prefix sums of decided (wall or path) edges, one table
+ * per edge orientation. Edges only ever go from undecided to decided
+ * during a solve, so the number of decided edges touching a block grows
+ * whenever anything in or around the block changes. That count is both
+ * the "block fully decided" test and the change tracker for solve_parity.
+ */
+static void build_decided_sums(const game_state *state, struct solver_scratch *scratch) {
+    int x,y;
     int w = state->w;
     int h = state->h;
-    for (i=0;i<w*(h+1);i++) {
-        if (state->edge_h[i] == FLAG_NONE) {
-            state->edge_h[i] = FLAG_WALL;
-            if (!check_partition(state)) {
-                if (scratch->verbose)
-                    printf("Horizontal edge at %i would partition the board -> set to path\n",i);
-                state->edge_h[i] = FLAG_PATH;
-                return true;
-            }
-            state->edge_h[i] = FLAG_NONE;
-        }
+    int *sh = scratch->sum_h;
+    int *sv = scratch->sum_v;
+
+    /* sum_h is (h+2) rows of (w+1), sum_v is (h+1) rows of (w+2) */
+    for (x=0;x<=w;x++) sh[x] = 0;
+    for (y=0;y<=h;y++) {
+        sh[(y+1)*(w+1)] = 0;
+        for (x=0;x<w;x++)
+            sh[(y+1)*(w+1)+x+1] = sh[y*(w+1)+x+1] + sh[(y+1)*(w+1)+x] - sh[y*(w+1)+x] +
+                                  (state->edge_h[y*w+x] != FLAG_NONE);
     }
-    for (i=0;i<(w+1)*h;i++) {
-        if (state->edge_v[i] == FLAG_NONE) {
-            state->edge_v[i] = FLAG_WALL;
-            if (!check_partition(state)) {
-                if (scratch->verbose)
-                    printf("Vertical edge at %i would partition the board -> set to path\n",i);
-                state->edge_v[i] = FLAG_PATH;
-                return true;
-            }
-            state->edge_v[i] = FLAG_NONE;
-        }
+    for (x=0;x<=w+1;x++) sv[x] = 0;
+    for (y=0;y<h;y++) {
+        sv[(y+1)*(w+2)] = 0;
+        for (x=0;x<=w;x++)
+            sv[(y+1)*(w+2)+x+1] = sv[y*(w+2)+x+1] + sv[(y+1)*(w+2)+x] - sv[y*(w+2)+x] +
+                                  (state->edge_v[y*(w+1)+x] != FLAG_NONE);
     }
+}
 
-    return false;
+static inline int rect_sum(const int *sum, int sw, int x0, int y0, int x1, int y1) {
+    return sum[y1*sw+x1] - sum[y0*sw+x1] - sum[y1*sw+x0] + sum[y0*sw+x0];
 }
 
-static inline bool parity(int x, int y) {
-    return (x^y)&1;
+/* Number of decided edges among the four sides of every cell in a block */
+static int block_decided(const int *sum_h, const int *sum_v, int w,
+    int bx, int by, int bw, int bh) {
+    return rect_sum(sum_h, w+1, bx, by, bx+bw,   by+bh+1) +
+           rect_sum(sum_v, w+2, bx, by, bx+bw+1, by+bh);
 }
 
 static bool parity_check_block(game_state *state, struct solver_scratch *scratch,
@@ -666,41 +1214,41 @@ static bool parity_check_block(game_state *state, struct solver_scratch *scratch
     int h = state->h;
     int w = state->w;
     unsigned char *edges[4];
-    int *dsf;
-    bool found;
-    bool result = false;
-    int processed_count = 0;
-    int *processed_cells = snewn(w*h, int);
-    int *group_cells = snewn(w*h, int);
-
-    scratch->done_islands[scratch->island_counter] = true;
+    int *dsf = scratch->blockdsf;
+    int *head = scratch->grouphead;
+    int *next = scratch->groupnext;
+    int *tail = scratch->grouptail;
+    int *group_cells = scratch->groupcells;
 
     /* Build a dsf over the relevant area */
-    dsf = snewn(w*h,int);
-    dsf_init(dsf, w*h);
+    for (y=by;y<by+bh;y++)
+        dsf_init(dsf + y*w + bx, bw);
     for (y=by;y<by+bh;y++)
     for (x=bx;x<bx+bw;x++) {
         i = x+y*w;
-        edges[0] = state->edge_h + y*w + x;
-        edges[1] = edges[0] + w;
-        edges[2] = state->edge_v + y*(w+1) + x;
-        edges[3] = edges[2] + 1;
-        if ((*edges[0] & FLAG_WALL) == 0x00 && y>by)        dsf_merge(dsf, i, i-w);
+        edges[1] = state->edge_h + y*w + x + w;
+        edges[3] = state->edge_v + y*(w+1) + x + 1;
         if ((*edges[1] & FLAG_WALL) == 0x00 && y<(by+bh)-1) dsf_merge(dsf, i, i+w);
-        if ((*edges[2] & FLAG_WALL) == 0x00 && x>bx)        dsf_merge(dsf, i, i-1);
         if ((*edges[3] & FLAG_WALL) == 0x00 && x<(bx+bw)-1) dsf_merge(dsf, i, i+1);
-        for (j=0;j<4;j++)
-            if (*edges[j] == FLAG_NONE)
-                scratch->done_islands[scratch->island_counter] = false;
     }
 
-    if (scratch->done_islands[scratch->island_counter]) {
-        goto finish_parity;
+    /* Chain the cells of each group in index order, so every group is
+     * visited once, starting from its lowest cell */
+    for (y=by;y<by+bh;y++)
+    for (x=bx;x<bx+bw;x++)
+        head[x+y*w] = -1;
+    for (y=by;y<by+bh;y++)
+    for (x=bx;x<bx+bw;x++) {
+        i = x+y*w;
+        f = dsf_canonify(dsf, i);
+        next[i] = -1;
+        if (head[f] < 0) head[f] = i;
+        else             next[tail[f]] = i;
+        tail[f] = i;
     }
 
     /* Process each separate dsf group */
-    for (i=0;i<w*h;i++) processed_cells[i] = -1;
-    while(true) {
+    for (j=0;j<bw*bh;j++) {
         int count_black, count_white;
         int avail_black, avail_white;
         int paths_black, paths_white;
@@ -717,31 +1265,18 @@ static bool parity_check_block(game_state *state, struct solver_scratch *scratch
         
         int group_count = 0;
 
+        i = (bx + j%bw) + (by + j/bw)*w;
+        f = dsf_canonify(dsf, i);
+        if (head[f] != i) continue;
+
         count_black = count_white = 0;
         avail_black = avail_white = 0;
-        paths_black = paths_white = 0;
-        walls_black = walls_white = 0;
-
-        for (i=0;i<w*h;i++) {
-            found = false;
-            for (j=0;j<w*h;j++) {
-                if (processed_cells[j] == i) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) break;
-        }
-        if (i==w*h) break;
+        paths_black = paths_white = 0;
+        walls_black = walls_white = 0;
 
-        f = dsf_canonify(dsf, i);
-        for (n = 0; n < w*h; n++) {
-            if (dsf_canonify(dsf, n) == f) {
-                processed_cells[processed_count++] = n;
-                group_cells[group_count++] = n;
-                x = n%state->w; y=n/state->w;
-                parity(x,y) ? count_white++ : count_black++;
-            }
+        for (n = i; n >= 0; n = next[n]) {
+            group_cells[group_count++] = n;
+            parity(n%w, n/w) ? count_white++ : count_black++;
         }
         if (group_count == 1) continue;
 
@@ -882,30 +1417,76 @@ static bool parity_check_block(game_state *state, struct solver_scratch *scratch
                     }
                 }
             }
-            result = true;
-            goto finish_parity;
+            return true;
         }
     }
-    
-finish_parity:
-    sfree(group_cells);
-    sfree(processed_cells);
-    sfree(dsf);
-    return result;
+
+    return false;
 }
 
+/*
+ * Remember the current decided-edge sums as seen by every block up to
+ * number reach of the pass that just ended. Older snapshots that reach
+ * no further are superseded; beyond PARITY_SNAPSHOTS the oldest one is
+ * dropped, and the blocks only it covered simply get checked again.
+ */
+static void push_parity_snapshot(struct solver_scratch *scratch, int reach) {
+    int i;
+    int *sh, *sv;
+    int w = scratch->w;
+    int h = scratch->h;
+
+    while (scratch->nsnaps > 0 && scratch->snap_reach[scratch->nsnaps-1] <= reach)
+        scratch->nsnaps--;
+    if (scratch->nsnaps == PARITY_SNAPSHOTS) {
+        sh = scratch->snap_h[0]; sv = scratch->snap_v[0];
+        for (i=1;i<PARITY_SNAPSHOTS;i++) {
+            scratch->snap_h[i-1] = scratch->snap_h[i];
+            scratch->snap_v[i-1] = scratch->snap_v[i];
+            scratch->snap_reach[i-1] = scratch->snap_reach[i];
+        }
+        scratch->snap_h[PARITY_SNAPSHOTS-1] = sh;
+        scratch->snap_v[PARITY_SNAPSHOTS-1] = sv;
+        scratch->nsnaps--;
+    }
+    i = scratch->nsnaps++;
+    memcpy(scratch->snap_h[i], scratch->sum_h, (w+1)*(h+2)*sizeof(int));
+    memcpy(scratch->snap_v[i], scratch->sum_v, (w+2)*(h+1)*sizeof(int));
+    scratch->snap_reach[i] = reach;
+}
+
+/*
+ * Blocks are examined in a fixed order, biggest first, and a pass stops
+ * at the first block that yields a deduction. A block needs no new look
+ * if its decided count is the same as on the last pass that got as far
+ * as it; that count comes from the snapshot of that pass. Keeping a few
+ * snapshots of the whole board instead of one count per block makes
+ * the memory grow with the board area rather than with its square.
+ */
 static bool solve_parity(game_state *state, struct solver_scratch *scratch) {
-    int w,h,x,y;
-    scratch->island_counter = 0;
+    int w,h,x,y,decided;
+    int block = 0;
+    int s = scratch->nsnaps - 1;
+    build_decided_sums(state, scratch);
     for (h=state->h;h>=2;h--) 
     for (w=state->w;w>=2;w--) {
         for (y=0;y<=state->h-h;y++)
         for (x=0;x<=state->w-w;x++) {
-            if (!scratch->done_islands[scratch->island_counter])
-                if (parity_check_block(state, scratch, x, y, w, h)) return true;
-            scratch->island_counter++;
+            /* Skip blocks that are fully decided, or unchanged since
+             * they were last examined */
+            while (s >= 0 && scratch->snap_reach[s] < block) s--;
+            decided = block_decided(scratch->sum_h, scratch->sum_v, state->w, x, y, w, h);
+            if (decided < w*(h+1) + (w+1)*h && (s < 0 || decided !=
+                block_decided(scratch->snap_h[s], scratch->snap_v[s], state->w, x, y, w, h))) {
+                if (parity_check_block(state, scratch, x, y, w, h)) {
+                    push_parity_snapshot(scratch, block);
+                    return true;
+                }
+            }
+            block++;
         }
     }
+    push_parity_snapshot(scratch, block);
     return false;
 }
 
@@ -956,90 +1537,53 @@ static bool solve_early_exits(game_state *state, struct solver_scratch *scratch)
     return false;
 }
 
-static bool check_for_loops(game_state *state) {
+static bool solve_loops(game_state *state, struct solver_scratch *scratch) {
     int i,x,y;
     int w = state->w;
     int h = state->h;
-    bool result = false;
-    unsigned char *edges[4];
-
-    gridstate *grid;
-    struct findloopstate *fls;
-    struct neighbour_ctx ctx;
+    int *dsf = scratch->pathdsf;
+    bool changed = false;
+    int paths = count_flagged(state, FLAG_PATH);
 
-    grid = snew(gridstate);
-    grid->faces = snewn(w*h, unsigned char);
-    grid->w = w; grid->h = h;
+    /* Walls placed here never add a path, so without a new path since the
+     * last call there is no new loop to prevent */
+    if (paths == scratch->loop_paths) return false;
+    scratch->loop_paths = paths;
 
+    /* Paths are never taken back during a solve, so merging every current
+     * path edge brings the fragment dsf up to date with whatever the other
+     * techniques placed since the last call. */
     for (y=0;y<h;y++)
     for (x=0;x<w;x++) {
         i = x+y*w;
-        edges[0] = state->edge_h + y*w + x;
-        edges[1] = edges[0] + w;
-        edges[2] = state->edge_v + y*(w+1) + x;
-        edges[3] = edges[2] + 1;
-        grid->faces[i] = BLANK;
-        if ((*edges[0] & FLAG_PATH) > 0x00) grid->faces[i] |= U;
-        if ((*edges[1] & FLAG_PATH) > 0x00) grid->faces[i] |= D;
-        if ((*edges[2] & FLAG_PATH) > 0x00) grid->faces[i] |= L;
-        if ((*edges[3] & FLAG_PATH) > 0x00) grid->faces[i] |= R;
-    }
-    fls = findloop_new_state(w*h);
-    ctx.grid = grid;
-    if (findloop_run(fls, w*h, neighbour, &ctx)) {
-        for (x = 0; x < w; x++) {
-            for (y = 0; y < h; y++) {
-                int u, v;
-                u = y*w + x;
-                for (v = neighbour(u, &ctx); v >= 0; v = neighbour(-1, &ctx)) {
-                    if (findloop_is_loop_edge(fls, u, v)) {
-                        result = true;
-                        goto finish_loopcheck;
-                    }
-                }
-            }
-        }
+        if (x<w-1 && (state->edge_v[y*(w+1)+x+1] & FLAG_PATH)) dsf_merge(dsf, i, i+1);
+        if (y<h-1 && (state->edge_h[(y+1)*w+x] & FLAG_PATH))   dsf_merge(dsf, i, i+w);
     }
 
-finish_loopcheck:
-
-    findloop_free_state(fls);
-    sfree(grid->faces);
-    sfree(grid);
-    return result;
-}
-
-static bool solve_loops(game_state *state, struct solver_scratch *scratch) {
-    int i;
-    int w = state->w;
-    int h = state->h;
-
-    for (i=0;i<w*(h+1);i++) {
-        if (state->edge_h[i] == FLAG_NONE) {
-            state->edge_h[i] = FLAG_PATH;
-            if (check_for_loops(state)) {
-                if (scratch->verbose)
-                    printf("Horizontal path at %i would create a loop -> set to wall\n",i);
-                state->edge_h[i] = FLAG_WALL;
-                return true;
-            }
-            state->edge_h[i] = FLAG_NONE;
+    /* An undecided edge joining two cells of the same path fragment would
+     * close a loop. Border edges touch a single cell and never do. */
+    for (i=w;i<w*h;i++) {
+        if (state->edge_h[i] == FLAG_NONE &&
+            dsf_canonify(dsf, i-w) == dsf_canonify(dsf, i)) {
+            if (scratch->verbose)
+                printf("Horizontal path at %i would create a loop -> set to wall\n",i);
+            state->edge_h[i] = FLAG_WALL;
+            changed = true;
         }
     }
-    for (i=0;i<(w+1)*h;i++) {
-        if (state->edge_v[i] == FLAG_NONE) {
-            state->edge_v[i] = FLAG_PATH;
-            if (check_for_loops(state)) {
-                if (scratch->verbose)
-                    printf("Vertical path at %i would create a loop -> set to wall\n",i);
-                state->edge_v[i] = FLAG_WALL;
-                return true;
-            }
-            state->edge_v[i] = FLAG_NONE;
+    for (y=0;y<h;y++)
+    for (x=1;x<w;x++) {
+        i = y*(w+1)+x;
+        if (state->edge_v[i] == FLAG_NONE &&
+            dsf_canonify(dsf, y*w+x-1) == dsf_canonify(dsf, y*w+x)) {
+            if (scratch->verbose)
+                printf("Vertical path at %i would create a loop -> set to wall\n",i);
+            state->edge_v[i] = FLAG_WALL;
+            changed = true;
         }
     }
 
-    return false;
+    return changed;
 }
 
 static bool solve_exit_parity(game_state *state, struct solver_scratch *scratch) {
@@ -1173,41 +1717,128 @@ static bool solve_exit_parity(game_state *state, struct solver_scratch *scratch)
     return false;
 }
 
-static int walls_solve(game_state *state, int difficulty, bool verbose) {
+static struct solver_scratch *new_scratch(int w, int h) {
     int i;
-    int w = state->w;
-    int h = state->h;
-    int islands = (((w-1)*(w))*((h-1)*(h)))/4;
     struct solver_scratch *scratch = snew(struct solver_scratch);
 
+    scratch->w = w;
+    scratch->h = h;
     scratch->loopdsf = snewn(w*h, int);
-    dsf_init(scratch->loopdsf, w*h);
-    scratch->done_islands = snewn(islands, bool);
+    scratch->pathdsf = snewn(w*h, int);
+    scratch->faces = snewn(w*h, unsigned char);
+    scratch->fls = findloop_new_state(w*h);
+    scratch->sum_h = snewn((w+1)*(h+2), int);
+    scratch->sum_v = snewn((w+2)*(h+1), int);
+    for (i=0;i<PARITY_SNAPSHOTS;i++) {
+        scratch->snap_h[i] = snewn((w+1)*(h+2), int);
+        scratch->snap_v[i] = snewn((w+2)*(h+1), int);
+    }
+    scratch->nsnaps = 0;
+    scratch->blockdsf = snewn(w*h, int);
+    scratch->grouphead = snewn(w*h, int);
+    scratch->groupnext = snewn(w*h, int);
+    scratch->grouptail = snewn(w*h, int);
+    scratch->groupcells = snewn(w*h, int);
+    scratch->hwall = snewn(h+1, uint64_t);
+    scratch->hpath = snewn(h+1, uint64_t);
+    scratch->hfree = snewn(h+1, uint64_t);
+    scratch->vwall = snewn(h, uint64_t);
+    scratch->vpath = snewn(h, uint64_t);
+    scratch->vfree = snewn(h, uint64_t);
+
+    return scratch;
+}
+
+static void free_scratch(struct solver_scratch *scratch) {
+    int i;
+    sfree(scratch->vfree);
+    sfree(scratch->vpath);
+    sfree(scratch->vwall);
+    sfree(scratch->hfree);
+    sfree(scratch->hpath);
+    sfree(scratch->hwall);
+    sfree(scratch->groupcells);
+    sfree(scratch->grouptail);
+    sfree(scratch->groupnext);
+    sfree(scratch->grouphead);
+    sfree(scratch->blockdsf);
+    for (i=0;i<PARITY_SNAPSHOTS;i++) {
+        sfree(scratch->snap_v[i]);
+        sfree(scratch->snap_h[i]);
+    }
+    sfree(scratch->sum_v);
+    sfree(scratch->sum_h);
+    findloop_free_state(scratch->fls);
+    sfree(scratch->faces);
+    sfree(scratch->pathdsf);
+    sfree(scratch->loopdsf);
+    sfree(scratch);
+}
+
+/* Bring a scratch back to its pre-solve state, so one allocation can
+ * serve any number of solves of the same board size */
+static void reset_scratch(struct solver_scratch *scratch, int difficulty, bool verbose) {
+    int n = scratch->w * scratch->h;
+
+    dsf_init(scratch->loopdsf, n);
+    dsf_init(scratch->pathdsf, n);
+    scratch->nsnaps = 0;
+    scratch->loop_paths = scratch->partition_walls = -1;
     scratch->exits_found = false;
     scratch->difficulty = difficulty;
     scratch->verbose = verbose;
-    for (i=0;i<islands;i++) scratch->done_islands[i] = false;
+}
+
+static bool run_technique(int tech,
+                          bool (*fn)(game_state *, struct solver_scratch *),
+                          game_state *state, struct solver_scratch *scratch) {
+#ifdef WALLS_STATS
+    double t0 = stats_clock();
+    bool ret = fn(state, scratch);
+    walls_total_stats.tries[tech]++;
+    if (ret) walls_total_stats.hits[tech]++;
+    walls_total_stats.seconds[tech] += stats_clock() - t0;
+    return ret;
+#else
+    return fn(state, scratch);
+#endif
+}
+
+#define TRY(tech, fn) run_technique(TECH_ ## tech, fn, state, scratch)
+
+static int walls_solve_scratch(game_state *state, struct solver_scratch *scratch,
+                               int difficulty, bool verbose) {
+    reset_scratch(scratch, difficulty, verbose);
+#ifdef WALLS_STATS
+    walls_total_stats.solves++;
+#endif
 
     while(true) {
-        if (difficulty >= DIFF_EASY   && solve_single_cells(state, scratch)) continue;
-        if (difficulty >= DIFF_EASY   && solve_early_exits(state, scratch)) continue;
+        if (difficulty >= DIFF_EASY   && TRY(SINGLE_CELLS, solve_single_cells)) continue;
+        if (difficulty >= DIFF_EASY   && TRY(EARLY_EXITS,  solve_early_exits)) continue;
         if (!verbose && check_solution(state, false) == SOLVED) break;
-        if (difficulty >= DIFF_NORMAL && solve_loops(state, scratch)) continue;
-        if (difficulty >= DIFF_NORMAL && solve_partitions(state, scratch)) continue;
+        if (difficulty >= DIFF_NORMAL && TRY(LOOPS,        solve_loops)) continue;
+        if (difficulty >= DIFF_NORMAL && TRY(PARTITIONS,   solve_partitions)) continue;
         if (!verbose && check_solution(state, false) == SOLVED) break;
-        if (difficulty >= DIFF_TRICKY && solve_loop_ladders(state, scratch)) continue;
-        if (difficulty >= DIFF_TRICKY && solve_exit_parity(state, scratch)) continue;
+        if (difficulty >= DIFF_TRICKY && TRY(LOOP_LADDERS, solve_loop_ladders)) continue;
+        if (difficulty >= DIFF_TRICKY && TRY(EXIT_PARITY,  solve_exit_parity)) continue;
         if (!verbose && check_solution(state, false) == SOLVED) break;
-        if (difficulty >= DIFF_HARD   && solve_parity(state, scratch)) continue;
+        if (difficulty >= DIFF_HARD   && TRY(PARITY,       solve_parity)) continue;
         break;
     }
 
-    sfree(scratch->done_islands);
-    sfree(scratch->loopdsf);
-    sfree(scratch);
     return check_solution(state, false);
 }
 
+#undef TRY
+
+static int walls_solve(game_state *state, int difficulty, bool verbose) {
+    struct solver_scratch *scratch = new_scratch(state->w, state->h);
+    int result = walls_solve_scratch(state, scratch, difficulty, verbose);
+    free_scratch(scratch);
+    return result;
+}
+
 /*
  * Path generator
  * 
@@ -1215,132 +1846,142 @@ static int walls_solve(game_state *state, int difficulty, bool verbose) {
  * http://clisby.net/projects/hamiltonian_path/
  */
 
-static void reverse_path(int i1, int i2, int *pathx, int *pathy) {
+/*
+ * The path is held as packed cell indices (x + y*w), together with the
+ * inverse map from cell to position in the path (-1 while the cell is
+ * not on it yet), so a backbite finds its neighbour without searching.
+ */
+static void reverse_path(int i1, int i2, int *path, int *pos) {
     int i;
     int ilim = (i2-i1+1)/2;
     int temp;
     for (i=0; i<ilim; i++) {
-        temp = pathx[i1+i];
-        pathx[i1+i] = pathx[i2-i];
-        pathx[i2-i] = temp;
-
-        temp = pathy[i1+i];
-        pathy[i1+i] = pathy[i2-i];
-        pathy[i2-i] = temp;
+        temp = path[i1+i];
+        path[i1+i] = path[i2-i];
+        path[i2-i] = temp;
+        pos[path[i1+i]] = i1+i;
+        pos[path[i2-i]] = i2-i;
     }
 }
 
-static int backbite_left(int step, int n, int *pathx, int *pathy, int w, int h) {
-    int neighx, neighy;
-    int i, inPath = false;
+static int step_cell(int step, int cell, int w, int h) {
+    int x = cell % w, y = cell / w;
     switch(step) {
-        case L: neighx = pathx[0]-1; neighy = pathy[0];   break;
-        case R: neighx = pathx[0]+1; neighy = pathy[0];   break;
-        case U: neighx = pathx[0];   neighy = pathy[0]-1; break;
-        case D: neighx = pathx[0];   neighy = pathy[0]+1; break; 
-        default: neighx = -1; neighy = -1; break;
+        case L: return (x > 0)   ? cell-1 : -1;
+        case R: return (x < w-1) ? cell+1 : -1;
+        case U: return (y > 0)   ? cell-w : -1;
+        case D: return (y < h-1) ? cell+w : -1;
+        default: return -1;
     }
-    if (neighx < 0 || neighx >= w || neighy < 0 || neighy >= h)
+}
+
+static int backbite_left(int step, int n, int *path, int *pos, int w, int h) {
+    int i;
+    int neigh = step_cell(step, path[0], w, h);
+    if (neigh < 0)
         return n;
 
-    for (i=1;i<n;i+=2) {
-        if (neighx == pathx[i] && neighy == pathy[i]) { inPath = true; break; }
-    }
-    if (inPath) {
-        reverse_path(0, i-1, pathx, pathy);
+    i = pos[neigh];
+    if (i >= 0) {
+        reverse_path(0, i-1, path, pos);
     }
     else {
-        reverse_path(0, n-1, pathx, pathy);
-        pathx[n] = neighx;
-        pathy[n] = neighy;
+        reverse_path(0, n-1, path, pos);
+        path[n] = neigh;
+        pos[neigh] = n;
         n++;
     }
 
     return n;
 }
 
-static int backbite_right(int step, int n, int *pathx, int *pathy, int w, int h) {
-    int neighx, neighy;
-    int i, inPath = false;
-    switch(step) {
-        case L: neighx = pathx[n-1]-1; neighy = pathy[n-1];   break;
-        case R: neighx = pathx[n-1]+1; neighy = pathy[n-1];   break;
-        case U: neighx = pathx[n-1];   neighy = pathy[n-1]-1; break;
-        case D: neighx = pathx[n-1];   neighy = pathy[n-1]+1; break; 
-        default: neighx = -1; neighy = -1; break;
-    }
-    if (neighx < 0 || neighx >= w || neighy < 0 || neighy >= h)
+static int backbite_right(int step, int n, int *path, int *pos, int w, int h) {
+    int i;
+    int neigh = step_cell(step, path[n-1], w, h);
+    if (neigh < 0)
         return n;
 
-    for (i=n-2;i>=0;i-=2) {
-        if (neighx == pathx[i] && neighy == pathy[i]) { inPath = true; break; }
-    }
-    if (inPath) {
-        reverse_path(i+1, n-1, pathx, pathy);
+    i = pos[neigh];
+    if (i >= 0) {
+        reverse_path(i+1, n-1, path, pos);
     }
     else {
-        pathx[n] = neighx;
-        pathy[n] = neighy;
+        path[n] = neigh;
+        pos[neigh] = n;
         n++;
     }
 
     return n;
 }
 
-static int backbite(int n, int *pathx, int *pathy, int w, int h, random_state *rs) {
+static int backbite(int n, int *path, int *pos, int w, int h, random_state *rs) {
     return (random_upto(rs, 2) == 0) ?
-        backbite_left( DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, w, h) :
-        backbite_right(DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, w, h);
+        backbite_left( DIRECTIONS[random_upto(rs,4)], n, path, pos, w, h) :
+        backbite_right(DIRECTIONS[random_upto(rs,4)], n, path, pos, w, h);
+}
+
+static bool on_border(int cell, int w, int h) {
+    int x = cell % w, y = cell / w;
+    return x == 0 || x == w-1 || y == 0 || y == h-1;
 }
 
 static void generate_hamiltonian_path(game_state *state, random_state *rs) {
     int w = state->w;
     int h = state->h;
-    int *pathx = snewn(w*h, int);
-    int *pathy = snewn(w*h, int);
+    int *path = snewn(w*h, int);
+    int *pos = snewn(w*h, int);
     int n = 1;
-    int pos, x, y;
-    pathx[0] = random_upto(rs, w);
-    pathy[0] = random_upto(rs, h);
+    int i, x, y, dx, dy;
+
+    for (i=0;i<w*h;i++) pos[i] = -1;
+    x = random_upto(rs, w);
+    y = random_upto(rs, h);
+    path[0] = x + y*w;
+    pos[path[0]] = 0;
 
     while (n < w*h) {
-        n = backbite(n, pathx, pathy, w, h, rs);
+        n = backbite(n, path, pos, w, h, rs);
     }
 
-    while (!(pathx[0] == 0 || pathx[0] == w-1) && 
-           !(pathy[0] == 0 || pathy[0] == h-1)) {
-        backbite_left(DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, w, h);
+    while (!on_border(path[0], w, h)) {
+        backbite_left(DIRECTIONS[random_upto(rs,4)], n, path, pos, w, h);
     }
 
-    while (!(pathx[n-1] == 0 || pathx[n-1] == w-1) && 
-           !(pathy[n-1] == 0 || pathy[n-1] == h-1)) {
-        backbite_right(DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, w, h);
+    while (!on_border(path[n-1], w, h)) {
+        backbite_right(DIRECTIONS[random_upto(rs,4)], n, path, pos, w, h);
     }
 
     for (n=0;n<w*h;n++) {
-        pos = pathx[n] + pathy[n]*w;
-        x = pos % w;
-        y = pos / w;
+        x = path[n] % w;
+        y = path[n] / w;
         if (n < (w*h-1)) {
-            if      (pathx[n+1] - pathx[n] ==  1) state->edge_v[y*(w+1)+x+1] = FLAG_NONE;
-            else if (pathx[n+1] - pathx[n] == -1) state->edge_v[y*(w+1)+x]   = FLAG_NONE;
-            else if (pathy[n+1] - pathy[n] ==  1) state->edge_h[y*w+x+w]     = FLAG_NONE;
-            else if (pathy[n+1] - pathy[n] == -1) state->edge_h[y*w+x]       = FLAG_NONE;
+            dx = path[n+1] % w - x;
+            dy = path[n+1] / w - y;
+            if      (dx ==  1) state->edge_v[y*(w+1)+x+1] = FLAG_NONE;
+            else if (dx == -1) state->edge_v[y*(w+1)+x]   = FLAG_NONE;
+            else if (dy ==  1) state->edge_h[y*w+x+w]     = FLAG_NONE;
+            else if (dy == -1) state->edge_h[y*w+x]       = FLAG_NONE;
         }
         if (n == 0 || n == (w*h)-1) {
-            if      (pathx[n] == 0)   state->edge_v[y*(w+1)+x]   = FLAG_NONE;
-            else if (pathx[n] == w-1) state->edge_v[y*(w+1)+x+1] = FLAG_NONE;
-            else if (pathy[n] == 0)   state->edge_h[y*w+x]       = FLAG_NONE;
-            else if (pathy[n] == h-1) state->edge_h[y*w+x+w]     = FLAG_NONE;
+            if      (x == 0)   state->edge_v[y*(w+1)+x]   = FLAG_NONE;
+            else if (x == w-1) state->edge_v[y*(w+1)+x+1] = FLAG_NONE;
+            else if (y == 0)   state->edge_h[y*w+x]       = FLAG_NONE;
+            else if (y == h-1) state->edge_h[y*w+x+w]     = FLAG_NONE;
         }
     }
 
-    sfree(pathx);
-    sfree(pathy);
+    sfree(path);
+    sfree(pos);
 
     return;
 }
 
+static void clear_state(game_state *state) {
+    memset(state->edge_h, FLAG_WALL | FLAG_FIXED, state->w*(state->h+1)*sizeof(unsigned char));
+    memset(state->edge_v, FLAG_WALL | FLAG_FIXED, (state->w+1)*state->h*sizeof(unsigned char));
+    memset(state->cellstate, FLAG_NONE, (state->w+2)*(state->h+2)*sizeof(unsigned char));
+}
+
 static game_state *new_state(const game_params *params) {
     game_state *state = snew(game_state);
 
@@ -1353,10 +1994,11 @@ static game_state *new_state(const game_params *params) {
     state->edge_h = snewn(state->w*(state->h + 1), unsigned char);
     state->edge_v = snewn((state->w + 1)*state->h, unsigned char);
     state->cellstate = snewn((state->w + 2)*(state->h + 2), unsigned char);
+    state->check = new_check_scratch(state->w, state->h);
+    state->checked = -1;
+    state->nbad = state->nopen = 0;
 
-    memset(state->edge_h, FLAG_WALL | FLAG_FIXED, state->w*(state->h+1)*sizeof(unsigned char));
-    memset(state->edge_v, FLAG_WALL | FLAG_FIXED, (state->w+1)*state->h*sizeof(unsigned char));
-    memset(state->cellstate, FLAG_NONE, (state->w+2)*(state->h+2)*sizeof(unsigned char));
+    clear_state(state);
 
     return state;
 }
@@ -1377,10 +2019,23 @@ static game_state *dup_state(const game_state *state) {
     memcpy(ret->edge_v, state->edge_v, (state->w + 1)*state->h * sizeof(unsigned char));
     memcpy(ret->cellstate, state->cellstate, (state->w+2)*(state->h+2)*sizeof(unsigned char));
 
+    ret->check = state->check;
+    ret->check->refcount++;
+    ret->checked = state->checked;
+    ret->nbad = state->nbad;
+    ret->nopen = state->nopen;
+
     return ret;
 }
 
+/* Overwrite the edges of a state of the same size, without reallocating */
+static void copy_edges(game_state *dst, const game_state *src) {
+    memcpy(dst->edge_h, src->edge_h, src->w*(src->h + 1) * sizeof(unsigned char));
+    memcpy(dst->edge_v, src->edge_v, (src->w + 1)*src->h * sizeof(unsigned char));
+}
+
 static void free_state(game_state *state) {
+    free_check_scratch(state->check);
     sfree(state->edge_v);
     sfree(state->edge_h);
     sfree(state->cellstate);
@@ -1411,6 +2066,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
                            char **aux, bool interactive) {
     game_state *new;
     game_state *tmp;
+    struct solver_scratch *scratch;
     
     char *desc, *e;
     int erun, wrun;
@@ -1427,8 +2083,19 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     int vo = w*(h+1);
     int *wallidx;
     int result;
+#ifdef WALLS_STATS
+    double t0;
+#endif
 
     wallidx = snewn(ws, int);
+
+    /* 'new' is the reference puzzle: it only ever loses walls that have
+     * been shown to leave it solvable. Each candidate removal is tried on
+     * the working copy 'tmp', restored from the reference beforehand, and
+     * every solve shares one scratch arena. */
+    new = new_state(params);
+    tmp = new_state(params);
+    scratch = new_scratch(w, h);
     
     while (true) {
         borderreduce = difficulty == DIFF_EASY   ? random_upto(rs, 4) :
@@ -1436,8 +2103,15 @@ static char *new_game_desc(const game_params *params, random_state *rs,
                                                    2*w+2*h;
 
         wallnum = bordernum = 0;
-        new = new_state(params);
+        clear_state(new);
+#ifdef WALLS_STATS
+        walls_total_stats.candidates++;
+        t0 = stats_clock();
+#endif
         generate_hamiltonian_path(new, rs);
+#ifdef WALLS_STATS
+        walls_total_stats.path_seconds += stats_clock() - t0;
+#endif
 
         for (i=0;i<w*(h+1);i++)
             if ((new->edge_h[i] & FLAG_WALL) > 0x00)
@@ -1481,26 +2155,26 @@ static char *new_game_desc(const game_params *params, random_state *rs,
             }
 
             /* Temporarily remove wall, check if game is still solveable */
-            tmp = dup_state(new);
+            copy_edges(tmp, new);
             if (wi<vo) tmp->edge_h[wi]    = FLAG_NONE;
             else       tmp->edge_v[wi-vo] = FLAG_NONE;
             
             /* It is, remove this wall permanently */
-            if (walls_solve(tmp, difficulty, false) == SOLVED) {
+            if (walls_solve_scratch(tmp, scratch, difficulty, false) == SOLVED) {
                 if (wi<vo) new->edge_h[wi]    = FLAG_NONE;
                 else       new->edge_v[wi-vo] = FLAG_NONE;
                 if (wi<vo && (wi/w == 0 || wi/w == h)) bordernum++;
                 else if ((wi-vo)%(w+1) == 0 || (wi-vo)%(w+1) == w) bordernum++;
             }
-            free_state(tmp);
         }
         if (difficulty == DIFF_EASY) break;
-        tmp = dup_state(new);
-        result = walls_solve(tmp, difficulty-1, false);
-        free_state(tmp);
+        copy_edges(tmp, new);
+        result = walls_solve_scratch(tmp, scratch, difficulty-1, false);
         if (result == SOLVED) {
             /* printf("Puzzle too easy - continue\n"); */
-            free_state(new);
+#ifdef WALLS_STATS
+            walls_total_stats.too_easy++;
+#endif
             continue;
         }
         break;
@@ -1532,6 +2206,8 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     if(erun > 0) *e++ = ('a' + erun - 1);
     *e++ = '\0';
     /* printf("Description: %s\n", desc); */
+    free_scratch(scratch);
+    free_state(tmp);
     free_state(new);
     sfree(wallidx);
 
@@ -1686,6 +2362,9 @@ struct game_ui {
     int *dragcoords;       /* list of (y*w+x) coords in drag so far */
     int ndragcoords;       /* number of entries in dragcoords. */
     unsigned char dragdir; /* Current direction of drag */
+    int *dragcells;        /* grid cells along the path being dragged */
+    int ndragcells;        /* number of those, 0 if not dragging */
+    int clickx, clicky;    /* where the drag started */
 
     int curx, cury;        /* grid position of keyboard cursor */
     bool cursor_active;    /* true if cursor is shown */
@@ -1702,6 +2381,8 @@ static game_ui *new_ui(const game_state *state) {
     ui->dragcoords = snewn((8*w+5)*(8*h+5), int);
     ui->ndragcoords = -1;
     ui->dragdir = BLANK;
+    ui->dragcells = snewn(w*h, int);
+    ui->ndragcells = 0;
     
     ui->cursor_active = false;
     ui->curx = ui->cury = 0;
@@ -1711,6 +2392,7 @@ static game_ui *new_ui(const game_state *state) {
 }
 
 static void free_ui(game_ui *ui) {
+    sfree(ui->dragcells);
     sfree(ui->dragcoords);
     sfree(ui);
 }
@@ -1724,6 +2406,8 @@ static void decode_ui(game_ui *ui, const char *encoding) {
 
 static void game_changed_state(game_ui *ui, const game_state *oldstate,
                                const game_state *newstate) {
+    ui->ndragcells = 0;
+    ui->ndragcoords = -1;
 }
 
 #define PREFERRED_TILE_SIZE (8)
@@ -1779,6 +2463,130 @@ static char *mark_in_direction(const game_state *state, int x, int y, int dir,
     return dupstr(buf);
 }
 
+/* Turn a click at (x,y) into a move on the nearest border of the cell */
+static char *click_move(const game_state *state, const game_drawstate *ds,
+                        int x, int y, bool primary, char *buf) {
+    int dir;
+    int w = state->w;
+    int h = state->h;
+    int fx = FROMCOORD(x);
+    int fy = FROMCOORD(y); 
+    int cx = CENTERED_COORD(fx);
+    int cy = CENTERED_COORD(fy);
+
+    /* printf("Clicked on cell %i/%i\n",fx,fy); */
+    if ((fx<0 && fy<0) || (fx>=w && fy<0) || (fx<0 && fy>=h) || (fx>=w && fy>=h)) return NULL;
+    if      (fx<0 && x > cx)  dir = R;
+    else if (fx>=w && x < cx) dir = L;
+    else if (fy<0 && y > cy)  dir = D;
+    else if (fy>=h && y < cy) dir = U;
+    else if (fx<0 || fx>=w || fy<0 || fy >=h) return NULL;
+    else {
+        if (abs(x-cx) < abs(y-cy)) dir = (y < cy) ? U : D;
+        else                       dir = (x < cx) ? L : R;
+    }
+    return mark_in_direction(state, fx, fy, dir, primary, buf);
+}
+
+/* The edge, in move numbering, between two neighbouring cells */
+static int edge_between(int a, int b, int w, int h) {
+    if (b == a-w) return a;
+    if (b == a+w) return b;
+    if (b == a-1) return w*(h+1) + a%w     + (a/w)*(w+1);
+    else          return w*(h+1) + a%w + 1 + (a/w)*(w+1);
+}
+
+static unsigned char edge_at(const game_state *state, int edge) {
+    int w = state->w;
+    int h = state->h;
+    return edge < w*(h+1) ? state->edge_h[edge] : state->edge_v[edge-w*(h+1)];
+}
+
+/*
+ * Extend the dragged path towards cell (fx,fy), one neighbouring cell at
+ * a time, going along the longer distance first. The drag never crosses a wall or visits
+ * a cell twice; stepping back onto the previous cell takes the last
+ * step back. Afterwards the line through the cell centres is laid out
+ * in dragcoords for game_redraw.
+ */
+static void update_ui_drag(const game_state *state, game_ui *ui, int fx, int fy) {
+    int i, k, last, next, lx, ly, dx, dy;
+    int w = state->w;
+    int h = state->h;
+
+    if (fx < 0 || fx >= w || fy < 0 || fy >= h) return;
+    while (true) {
+        last = ui->dragcells[ui->ndragcells-1];
+        lx = last%w; ly = last/w;
+        if (lx == fx && ly == fy) break;
+        if (abs(fx-lx) >= abs(fy-ly)) {
+            dx = (fx > lx) ? 1 : -1; dy = 0;
+        }
+        else {
+            dx = 0; dy = (fy > ly) ? 1 : -1;
+        }
+        next = (lx+dx) + (ly+dy)*w;
+        if (ui->ndragcells > 1 && ui->dragcells[ui->ndragcells-2] == next) {
+            ui->ndragcells--;
+            continue;
+        }
+        if ((edge_at(state, edge_between(last, next, w, h)) & FLAG_WALL) > 0x00) break;
+        for (i=0;i<ui->ndragcells;i++)
+            if (ui->dragcells[i] == next) break;
+        if (i < ui->ndragcells) break;
+        ui->dragcells[ui->ndragcells++] = next;
+    }
+
+    if (ui->ndragcells < 2) {
+        ui->ndragcoords = -1;
+        return;
+    }
+    lx = 8*(ui->dragcells[0]%w) + 6;
+    ly = 8*(ui->dragcells[0]/w) + 6;
+    ui->ndragcoords = 0;
+    ui->dragcoords[ui->ndragcoords++] = lx + ly*(8*w+5);
+    for (i=1;i<ui->ndragcells;i++) {
+        next = ui->dragcells[i];
+        dx = 8*(next%w) + 6 > lx ? 1 : 8*(next%w) + 6 < lx ? -1 : 0;
+        dy = 8*(next/w) + 6 > ly ? 1 : 8*(next/w) + 6 < ly ? -1 : 0;
+        for (k=0;k<8;k++) {
+            lx += dx; ly += dy;
+            ui->dragcoords[ui->ndragcoords++] = lx + ly*(8*w+5);
+        }
+    }
+}
+
+/*
+ * The move for a finished drag: lay a path along every border the drag
+ * crossed, in one batch. Dragging along a path that is already complete
+ * erases it instead.
+ */
+static char *drag_move(const game_state *state, const game_ui *ui) {
+    int i, edge;
+    int w = state->w;
+    int h = state->h;
+    bool erase = true;
+    char *buf, *p;
+    const char *sep = "";
+
+    for (i=1;i<ui->ndragcells;i++) {
+        edge = edge_between(ui->dragcells[i-1], ui->dragcells[i], w, h);
+        if ((edge_at(state, edge) & FLAG_PATH) == 0x00) erase = false;
+    }
+
+    buf = snewn(ui->ndragcells * 16, char);
+    p = buf;
+    for (i=1;i<ui->ndragcells;i++) {
+        edge = edge_between(ui->dragcells[i-1], ui->dragcells[i], w, h);
+        if (erase || (edge_at(state, edge) & FLAG_PATH) == 0x00) {
+            p += sprintf(p, "%s%c%d", sep, erase ? 'C' : 'P', edge);
+            sep = ";";
+        }
+    }
+    *p = '\0';
+    return buf;
+}
+
 static char *interpret_move(const game_state *state, game_ui *ui,
                             const game_drawstate *ds,
                             int x, int y, int button) {
@@ -1789,40 +2597,54 @@ static char *interpret_move(const game_state *state, game_ui *ui,
     int h = state->h;
     int fx = FROMCOORD(x);
     int fy = FROMCOORD(y); 
-    int cx = CENTERED_COORD(fx);
-    int cy = CENTERED_COORD(fy);
 
     bool shift = button & MOD_SHFT, control = button & MOD_CTRL;
     button &= ~MOD_MASK;
 
     if (button == LEFT_BUTTON || button == RIGHT_BUTTON) {
-        int dir;
         ui->cursor_active = false;
-        if (ui->ndragcoords > 0 ) {
+        if (ui->ndragcells > 0) {
+            ui->ndragcells = 0;
             ui->ndragcoords = -1;
             return UI_UPDATE;
         }
+        /* A left button press inside the grid may start a path drag;
+         * if it is released in the same cell it counts as a click */
+        if (button == LEFT_BUTTON && fx >= 0 && fx < w && fy >= 0 && fy < h) {
+            ui->dragcells[0] = fx + fy*w;
+            ui->ndragcells = 1;
+            ui->clickx = x; ui->clicky = y;
+            return UI_UPDATE;
+        }
+        return click_move(state, ds, x, y, button == LEFT_BUTTON, buf);
+    }
+
+    if (button == LEFT_DRAG) {
+        if (ui->ndragcells == 0) return NULL;
+        update_ui_drag(state, ui, fx, fy);
+        return UI_UPDATE;
+    }
+
+    if (button == LEFT_RELEASE) {
+        if (ui->ndragcells == 0) return NULL;
+        if (ui->ndragcells == 1)
+            move = click_move(state, ds, ui->clickx, ui->clicky, true, buf);
         else {
-            ui->ndragcoords = -1;
-            /* printf("Clicked on cell %i/%i\n",fx,fy); */
-            if ((fx<0 && fy<0) || (fx>=w && fy<0) || (fx<0 && fy>=h) || (fx>=w && fy>=h)) return NULL;
-            if      (fx<0 && x > cx)  dir = R;
-            else if (fx>=w && x < cx) dir = L;
-            else if (fy<0 && y > cy)  dir = D;
-            else if (fy>=h && y < cy) dir = U;
-            else if (fx<0 || fx>=w || fy<0 || fy >=h) return NULL;
-            else {
-                if (abs(x-cx) < abs(y-cy)) dir = (y < cy) ? U : D;
-                else                       dir = (x < cx) ? L : R;
+            move = drag_move(state, ui);
+            if (!*move) {
+                sfree(move);
+                move = UI_UPDATE;
             }
-            return mark_in_direction(state, fx, fy, dir, button == LEFT_BUTTON, buf);
         }
+        ui->ndragcells = 0;
+        ui->ndragcoords = -1;
+        return move;
     }
 
     if (IS_CURSOR_MOVE(button)) {
         if (!ui->cursor_active) ui->cursor_active = true;
         else if (control || shift) {
-            if (ui->ndragcoords > 0) return NULL;
+            if (ui->ndragcells > 0) return NULL;
             ui->ndragcoords = -1;
             move = mark_in_direction(state, ui->curx, ui->cury, KEY_DIRECTION(button), control, buf);
             if (control && !shift && *move)
@@ -1852,8 +2674,11 @@ static game_state *execute_move(const game_state *state, const char *move) {
     int w = state->w;
     int h = state->h;
     game_state *ret = dup_game(state);
+    struct check_scratch *cs = ret->check;
     /* printf("Move: '%s'\n", move); */
 
+    cs->nmoved = 0;
+
     while (*move) {
         c = *move;
         if (c == 'S') {
@@ -1862,7 +2687,8 @@ static game_state *execute_move(const game_state *state, const char *move) {
         } 
         else if (c == 'W' || c == 'P' || c == 'C') {
             move++;
-            if (sscanf(move, "%d%n", &edge, &n) < 1) {
+            if (sscanf(move, "%d%n", &edge, &n) < 1 ||
+                edge < 0 || edge >= w*(h+1) + (w+1)*h) {
                 free_game(ret);
                 return NULL;
             }
@@ -1871,6 +2697,9 @@ static game_state *execute_move(const game_state *state, const char *move) {
                                  FLAG_NONE;
             if (edge < w*(h+1)) ret->edge_h[edge] = newedge;
             else ret->edge_v[edge-w*(h+1)] = newedge;
+            if (cs->nmoved >= 0 && cs->nmoved < w*(h+1) + (w+1)*h)
+                cs->moved[cs->nmoved++] = edge;
+            else cs->nmoved = -1;
             move += n;
         }
         if (*move == ';')
@@ -1881,7 +2710,7 @@ static game_state *execute_move(const game_state *state, const char *move) {
         }
     }
 
-    if (check_solution(ret, true) == SOLVED) ret->completed = true;
+    if (check_move(ret, state) == SOLVED) ret->completed = true;
 
     return ret;
 }
@@ -2258,9 +3087,15 @@ const struct game thegame = {
     REQUIRE_RBUTTON,       /* flags */
 };
 
-#ifdef DEVELOP
+#ifdef STANDALONE_SOLVER
 
-#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define HAVE_RUSAGE
+#endif
+
+const char *quis = NULL;
+static bool json = false;
 
 static void print_grid(const game_state *state) {
     char *grid;
@@ -2269,38 +3104,286 @@ static void print_grid(const game_state *state) {
     sfree(grid);
 }
 
-int main(int argc, char **argv) {
-    game_params *p;
-    random_state *rs;
-    game_state *state;
+/*
+ * Grade a puzzle: the lowest difficulty at which the solver finishes
+ * it, or DIFFCOUNT if even Hard can't. The solved state at that level
+ * is left in 'state'.
+ */
+static int grade_walls(game_state *state) {
+    int diff;
+    game_state *orig = dup_state(state);
+    struct solver_scratch *scratch = new_scratch(state->w, state->h);
+
+    for (diff = 0; diff < DIFFCOUNT; diff++) {
+        copy_edges(state, orig);
+        if (walls_solve_scratch(state, scratch, diff, false) == SOLVED)
+            break;
+    }
+
+    free_scratch(scratch);
+    free_state(orig);
+    return diff;
+}
+
+static const char *diffname(int diff) {
+    return diff < DIFFCOUNT ? walls_diffnames[diff] : "Unsolvable";
+}
+
+static void check(const game_params *p) {
+    const char *msg = validate_params(p, true);
+    if (msg) {
+        fprintf(stderr, "%s: %s\n", quis, msg);
+        exit(1);
+    }
+}
+
+static int solve(const game_params *p, const char *id, const char *desc,
+                 bool verbose) {
+    game_state *state = new_game(NULL, p, desc);
+    double t0 = stats_clock();
+    int diff = grade_walls(state);
+    double t1 = stats_clock();
+
+    if (json)
+        printf("{\"id\":\"%s\",\"difficulty\":\"%s\",\"ms\":%.3f}\n",
+               id, diffname(diff), (t1 - t0) * 1000.0);
+    else if (diff < DIFFCOUNT)
+        printf("Game has difficulty %s.\n", walls_diffnames[diff]);
+    else
+        printf("Game has no unique solution within the solver's reach.\n");
+    if (verbose) {
+        game_state *vstate = new_game(NULL, p, desc);
+        walls_solve(vstate, DIFF_HARD, true);
+        print_grid(vstate);
+        free_state(vstate);
+    }
+    free_state(state);
+    return diff;
+}
+
+static void gen(const game_params *p, random_state *rs, bool verbose) {
+    char *desc, *params, *id;
+
+    check(p);
+    desc = new_game_desc(p, rs, NULL, false);
+    params = encode_params(p, true);
+    id = snewn(strlen(params) + strlen(desc) + 2, char);
+    sprintf(id, "%s:%s", params, desc);
+    if (!json) printf("%s\n", id);
+    solve(p, id, desc, verbose);
+    sfree(id);
+    sfree(params);
+    sfree(desc);
+}
+
+/* Grade a game ID, or generate a puzzle if it is only a parameter string */
+static void process_id(const char *arg, random_state *rs, bool verbose) {
+    char *id = dupstr(arg);
+    char *desc = strchr(id, ':');
+    game_params *p = default_params();
+
+    if (desc) *desc++ = '\0';
+    decode_params(p, id);
+    check(p);
+    if (desc) {
+        const char *err = validate_desc(p, desc);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", quis, err);
+            exit(1);
+        }
+        solve(p, arg, desc, verbose);
+    }
+    else
+        gen(p, rs, verbose);
+    free_params(p);
+    sfree(id);
+}
+
+static void soak(const game_params *p, random_state *rs) {
+    time_t tt_start, tt_now, tt_last;
     char *desc;
-    int i;
-    int solved;
-    time_t seed = time(NULL);
-
-    rs = random_new((void*)&seed, sizeof(time_t));
-    /* rs = random_new("123456", 6); */
-    p = default_params();
-    p->w = 8;
-    p->h = 9;
-    p->difficulty = DIFF_HARD;
-
-    for (i=0;i<10;i++) {
-        desc = new_game_desc(p, rs, NULL, 0);
+    game_state *state;
+    int n = 0, nbad = 0;
+
+    check(p);
+
+    tt_start = tt_now = time(NULL);
+
+    printf("Soak-generating a %dx%d grid, difficulty %s.\n",
+           p->w, p->h, walls_diffnames[p->difficulty]);
+
+    while (true) {
+        desc = new_game_desc(p, rs, NULL, false);
         state = new_game(NULL, p, desc);
-        walls_solve(state, DIFF_HARD, false);
-        print_grid(state);
-        solved = check_solution(state, true);
-        printf("Solved: %s\n", solved == 0 ? "SOLVED" : solved == 1 ? "INVALID" : "AMBIGUOUS");
+        if (grade_walls(state) != p->difficulty) {
+            printf("Misgraded: %s\n", desc);
+            nbad++;
+        }
         free_state(state);
         sfree(desc);
-        if (solved != 0) break;
+
+        n++;
+
+        tt_last = time(NULL);
+        if (tt_last > tt_now) {
+            tt_now = tt_last;
+            printf("%d total, %3.1f/s; %d misgraded.\n",
+                   n, (double)n / ((double)tt_now - tt_start), nbad);
+            fflush(stdout);
+        }
+    }
+}
+
+static long peak_rss_kb(void) {
+#ifdef HAVE_RUSAGE
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return -1;
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+static int compare_doubles(const void *av, const void *bv) {
+    double a = *(const double *)av, b = *(const double *)bv;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+/*
+ * Generate n puzzles at the given parameters and print one JSON object
+ * of throughput, latency, generator retries and per-technique solver
+ * time.
+ */
+static void bench(const game_params *p, random_state *rs, const char *seed, int n) {
+    double *lat = snewn(n, double), total = 0.0;
+    struct walls_stats st;
+    char *params;
+    int i;
+
+    check(p);
+
+    walls_get_stats(&st, true);
+    for (i = 0; i < n; i++) {
+        double t0 = stats_clock();
+        char *desc = new_game_desc(p, rs, NULL, false);
+        lat[i] = stats_clock() - t0;
+        total += lat[i];
+        sfree(desc);
+    }
+    qsort(lat, n, sizeof(double), compare_doubles);
+    walls_get_stats(&st, true);
+
+    params = encode_params(p, true);
+    printf("{\"params\":\"%s\",\"seed\":\"%s\",\"n\":%d,"
+           "\"puzzles_per_sec\":%.3f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,",
+           params, seed, n, total > 0 ? n / total : 0.0,
+           lat[(n-1) / 2] * 1000.0, lat[(n * 99 - 1) / 100] * 1000.0);
+    printf("\"candidates\":%lu,\"too_easy\":%lu,\"path_ms\":%.3f,"
+           "\"solves\":%lu,\"peak_rss_kb\":%ld,\"techniques\":{",
+           st.candidates, st.too_easy, st.path_seconds * 1000.0,
+           st.solves, peak_rss_kb());
+    for (i = 0; i < NTECH; i++)
+        printf("%s\"%s\":{\"tries\":%lu,\"hits\":%lu,\"ms\":%.3f}",
+               i ? "," : "", walls_technames[i],
+               st.tries[i], st.hits[i], st.seconds[i] * 1000.0);
+    printf("}}\n");
+    fflush(stdout);
+    sfree(params);
+    sfree(lat);
+}
+
+static void usage_exit(const char *msg) {
+    if (msg)
+        fprintf(stderr, "%s: %s\n", quis, msg);
+    fprintf(stderr, "Usage: %s [-v] [--json] [--seed SEED]\n"
+            "           [--soak <params> | --bench [-n N] [<params> ...] |"
+            " <params> | <game_id> ... | -]\n", quis);
+    exit(1);
+}
+
+int main(int argc, const char *argv[]) {
+    random_state *rs;
+    char seed[64];
+    bool do_soak = false, do_bench = false, verbose = false;
+    int nbench = 20;
+    game_params *p;
+    int i;
+
+    sprintf(seed, "%ld", (long)time(NULL));
+
+    quis = argv[0];
+    while (--argc > 0) {
+        const char *arg = *++argv;
+        if (!strcmp(arg, "--soak"))
+            do_soak = true;
+        else if (!strcmp(arg, "--bench"))
+            do_bench = true;
+        else if (!strcmp(arg, "-v"))
+            verbose = true;
+        else if (!strcmp(arg, "--json"))
+            json = true;
+        else if (!strcmp(arg, "--seed") || !strcmp(arg, "-n")) {
+            if (argc < 2)
+                usage_exit("option needs an argument");
+            argc--;
+            argv++;
+            if (!strcmp(arg, "--seed")) {
+                strncpy(seed, *argv, sizeof(seed) - 1);
+                seed[sizeof(seed) - 1] = '\0';
+            }
+            else if ((nbench = atoi(*argv)) < 1)
+                usage_exit("-n needs a positive count");
+        }
+        else if (*arg == '-' && arg[1])
+            usage_exit("unrecognised option");
+        else
+            break;
+    }
+    rs = random_new(seed, strlen(seed));
+
+    if (do_soak) {
+        if (argc != 1) usage_exit("only one argument for --soak");
+        p = default_params();
+        decode_params(p, *argv);
+        soak(p, rs);
+    }
+    else if (do_bench) {
+        if (argc == 0) {
+            for (i = 0; i < lenof(walls_presets); i++)
+                bench(&walls_presets[i], rs, seed, nbench);
+        }
+        else {
+            for (i = 0; i < argc; i++) {
+                p = default_params();
+                decode_params(p, argv[i]);
+                bench(p, rs, seed, nbench);
+                free_params(p);
+            }
+        }
+    }
+    else if (argc > 0) {
+        for (i = 0; i < argc; i++) {
+            if (!strcmp(argv[i], "-")) {
+                char line[4096];
+                while (fgets(line, sizeof(line), stdin)) {
+                    line[strcspn(line, "\r\n")] = '\0';
+                    if (*line) process_id(line, rs, verbose);
+                }
+            }
+            else
+                process_id(argv[i], rs, verbose);
+        }
     }
+    else
+        usage_exit(NULL);
 
     random_free(rs);
-    free_params(p);
     return 0;
 }
 
 #endif
-